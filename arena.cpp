@@ -0,0 +1,42 @@
+#include<cstdint>
+#include<cstdlib>
+
+#include"arena.h"
+
+namespace lox {
+
+Arena::~Arena()
+{
+    for(Finalizer* f = finalizers; f != nullptr; f = f->next) f->destroy(f->object);
+
+    while(blocks != nullptr)
+    {
+        Block* next = blocks->next;
+        std::free(blocks);
+        blocks = next;
+    }
+}
+
+void* Arena::allocate(std::size_t size, std::size_t align)
+{
+    std::uintptr_t p = (reinterpret_cast<std::uintptr_t>(cursor) + align - 1) & ~(align - 1);
+
+    if(cursor == nullptr || p + size > reinterpret_cast<std::uintptr_t>(limit))
+    {
+        /* oversized requests get a block to themselves */
+        std::size_t bytes = sizeof(Block) + align + (size > BLOCK_SIZE ? size : BLOCK_SIZE);
+        Block* block = static_cast<Block*>(std::malloc(bytes));
+        if(block == nullptr) throw std::bad_alloc();
+        block->next = blocks;
+        blocks = block;
+        cursor = reinterpret_cast<char*>(block + 1);
+        limit = reinterpret_cast<char*>(block) + bytes;
+        p = (reinterpret_cast<std::uintptr_t>(cursor) + align - 1) & ~(align - 1);
+    }
+
+    cursor = reinterpret_cast<char*>(p + size);
+    used += size;
+    return reinterpret_cast<void*>(p);
+}
+
+} // namespace lox
@@ -0,0 +1,103 @@
+#ifndef LOX_ARENA_H
+#define LOX_ARENA_H
+
+#include<cstddef>
+#include<memory>
+#include<new>
+#include<type_traits>
+#include<utility>
+#include<vector>
+
+namespace lox {
+
+/* a fixed-size array living in an Arena, e.g. the statements of a block */
+template<typename T>
+class ArenaList {
+public:
+    ArenaList() = default;
+    ArenaList(T* items, std::size_t count): items(items), count(count) {}
+
+    T* begin() const {
+        return items;
+    }
+    T* end() const {
+        return items + count;
+    }
+    std::size_t size() const {
+        return count;
+    }
+    bool empty() const {
+        return count == 0;
+    }
+    T& operator[](std::size_t i) const {
+        return items[i];
+    }
+
+private:
+    T* items = nullptr;
+    std::size_t count = 0;
+};
+
+/*
+** A bump allocator for the AST of one compilation unit. Nodes are carved out
+** of large blocks and never freed individually: the whole tree goes at once
+** when the Arena is destroyed, with no recursion through the nodes. Only
+** objects that aren't trivially destructible (e.g. a Literal holding a
+** string) are remembered so their destructors can run.
+*/
+class Arena {
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    ~Arena();
+
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        T* object = new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr(!std::is_trivially_destructible<T>::value)
+        {
+            Finalizer* f = new(allocate(sizeof(Finalizer), alignof(Finalizer)))
+            Finalizer{[](void* p) { static_cast<T*>(p)->~T(); }, object, finalizers};
+            finalizers = f;
+        }
+        return object;
+    }
+
+    template<typename T>
+    ArenaList<T> list(const std::vector<T>& items) {
+        static_assert(std::is_trivially_destructible<T>::value, "ArenaList items are never destroyed");
+        if(items.empty()) return ArenaList<T>();
+        T* p = static_cast<T*>(allocate(sizeof(T) * items.size(), alignof(T)));
+        std::uninitialized_copy(items.begin(), items.end(), p);
+        return ArenaList<T>(p, items.size());
+    }
+
+    void* allocate(std::size_t size, std::size_t align);
+
+    /* bytes handed out so far, for diagnostics */
+    std::size_t bytesUsed() const {
+        return used;
+    }
+
+private:
+    struct Finalizer {
+        void (*destroy)(void*);
+        void* object;
+        Finalizer* next;
+    };
+    struct Block {
+        Block* next;
+    };
+
+    static constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+
+    Block* blocks = nullptr;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    Finalizer* finalizers = nullptr;
+    std::size_t used = 0;
+};
+
+} // namespace lox
+
+#endif
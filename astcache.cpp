@@ -0,0 +1,664 @@
+#include<sys/stat.h>
+#include<unistd.h>
+
+#include<cerrno>
+#include<cmath>
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<unordered_map>
+#include<vector>
+
+#include"astcache.h"
+#include"source.h"
+
+namespace lox
+{
+
+namespace {
+
+/* everything that makes an entry unreadable by a different build */
+const std::string STAMP = "cpplox-ast " + std::to_string(AstCache::FORMAT_VERSION) +
+                          " " __VERSION__;
+const char MAGIC[8] = {'L', 'O', 'X', 'A', 'S', 'T', '\r', '\n'};
+
+/* tag 0 is a missing child, e.g. an If without an else */
+enum ExprTag : unsigned char {
+    ASSIGN_EXPR = 1, BINARY_EXPR, CALL_EXPR, GET_EXPR, GROUPING_EXPR, LITERAL_EXPR,
+    LOGICAL_EXPR, SET_EXPR, SUPER_EXPR, THIS_EXPR, UNARY_EXPR, VARIABLE_EXPR
+};
+enum StmtTag : unsigned char {
+    BLOCK_STMT = 1, CLASS_STMT, EXPRESSION_STMT, FUNCTION_STMT, IF_STMT, PRINT_STMT,
+    RETURN_STMT, VAR_STMT, WHILE_STMT, BREAK_STMT, CONTINUE_STMT
+};
+/* whole numbers, the usual kind of literal, are written as varints */
+enum LiteralTag : unsigned char {
+    NIL_LITERAL, FALSE_LITERAL, TRUE_LITERAL, INTEGER_LITERAL, NUMBER_LITERAL, STRING_LITERAL
+};
+
+/*
+** Writes a Program as a stream of tagged nodes. The names it meets are
+** numbered in order of first use and written out ahead of the nodes.
+*/
+class Writer : public ExprVisitor, public StmtVisitor {
+public:
+    std::string nodes;
+    std::vector<Symbol> names;
+
+    void varint(std::uint64_t n) {
+        while(n >= 0x80)
+        {
+            nodes.push_back(static_cast<char>(n | 0x80));
+            n >>= 7;
+        }
+        nodes.push_back(static_cast<char>(n));
+    }
+    void byte(unsigned char b) {
+        nodes.push_back(static_cast<char>(b));
+    }
+    void symbol(Symbol s) {
+        auto [it, added] = numbers.try_emplace(s, names.size());
+        if(added) names.push_back(s);
+        varint(it->second);
+    }
+    void expr(ExprPtr e) {
+        if(e == nullptr) byte(0);
+        else e->accept(*this);
+    }
+    void stmt(StmtPtr s) {
+        if(s == nullptr) byte(0);
+        else s->accept(*this);
+    }
+    void stmts(const ArenaList<StmtPtr>& list) {
+        varint(list.size());
+        for(StmtPtr s : list) stmt(s);
+    }
+    /* lines are written as the difference from the last one, usually 0 */
+    void line(unsigned int n) {
+        std::int64_t delta = std::int64_t(n) - std::int64_t(lastLine);
+        varint(delta < 0 ? (std::uint64_t(-delta) << 1) - 1 : std::uint64_t(delta) << 1);
+        lastLine = n;
+    }
+    void header(unsigned char tag, const Expr& e) {
+        byte(tag);
+        line(e.line);
+    }
+
+    Value visitAssignExpr(Assign& e) override {
+        header(ASSIGN_EXPR, e);
+        symbol(e.name);
+        expr(e.value);
+        return nullptr;
+    }
+    Value visitBinaryExpr(Binary& e) override {
+        header(BINARY_EXPR, e);
+        byte(e.oper);
+        expr(e.left);
+        expr(e.right);
+        return nullptr;
+    }
+    Value visitCallExpr(Call& e) override {
+        header(CALL_EXPR, e);
+        expr(e.callee);
+        varint(e.args.size());
+        for(ExprPtr arg : e.args) expr(arg);
+        return nullptr;
+    }
+    Value visitGetExpr(Get& e) override {
+        header(GET_EXPR, e);
+        symbol(e.name);
+        expr(e.object);
+        return nullptr;
+    }
+    Value visitGroupingExpr(Grouping& e) override {
+        header(GROUPING_EXPR, e);
+        expr(e.expr);
+        return nullptr;
+    }
+    Value visitLiteralExpr(Literal& e) override {
+        header(LITERAL_EXPR, e);
+        double d = e.value.isNumber() ? e.value.asNumber() : 0;
+        if(e.value.isNumber() && d >= 0 && d < 0x1p53 &&
+                d == static_cast<double>(static_cast<std::uint64_t>(d)) && !std::signbit(d))
+        {
+            byte(INTEGER_LITERAL);
+            varint(static_cast<std::uint64_t>(d));
+        }
+        else if(e.value.isNumber())
+        {
+            std::uint64_t bits;
+            std::memcpy(&bits, &d, sizeof bits);
+            byte(NUMBER_LITERAL);
+            for(int i = 0; i < 8; ++i) byte(static_cast<unsigned char>(bits >> (8 * i)));
+        }
+        else if(e.value.isString())
+        {
+            const std::string& s = e.value.asString();
+            byte(STRING_LITERAL);
+            varint(s.size());
+            nodes += s;
+        }
+        else if(e.value.isBool())
+            byte(e.value.asBool() ? TRUE_LITERAL : FALSE_LITERAL);
+        else byte(NIL_LITERAL);
+        return nullptr;
+    }
+    Value visitLogicalExpr(Logical& e) override {
+        header(LOGICAL_EXPR, e);
+        byte(e.oper);
+        expr(e.left);
+        expr(e.right);
+        return nullptr;
+    }
+    Value visitSetExpr(Set& e) override {
+        header(SET_EXPR, e);
+        symbol(e.name);
+        expr(e.object);
+        expr(e.value);
+        return nullptr;
+    }
+    Value visitSuperExpr(Super& e) override {
+        header(SUPER_EXPR, e);
+        symbol(e.method);
+        return nullptr;
+    }
+    Value visitThisExpr(This& e) override {
+        header(THIS_EXPR, e);
+        return nullptr;
+    }
+    Value visitUnaryExpr(Unary& e) override {
+        header(UNARY_EXPR, e);
+        byte(e.oper);
+        expr(e.right);
+        return nullptr;
+    }
+    Value visitVariableExpr(Variable& e) override {
+        header(VARIABLE_EXPR, e);
+        symbol(e.name);
+        return nullptr;
+    }
+
+    void visitBlockStmt(Block& s) override {
+        byte(BLOCK_STMT);
+        line(s.line);
+        stmts(s.statements);
+    }
+    void visitBreakStmt(Break& s) override {
+        byte(BREAK_STMT);
+        line(s.line);
+    }
+    void visitClassStmt(Class& s) override {
+        byte(CLASS_STMT);
+        symbol(s.name);
+        line(s.line);
+        expr(s.superclass);
+        varint(s.methods.size());
+        for(FunPtr method : s.methods) stmt(method);
+    }
+    void visitContinueStmt(Continue& s) override {
+        byte(CONTINUE_STMT);
+        line(s.line);
+    }
+    void visitExpressionStmt(Expression& s) override {
+        byte(EXPRESSION_STMT);
+        expr(s.expression);
+    }
+    void visitFunctionStmt(Function& s) override {
+        byte(FUNCTION_STMT);
+        symbol(s.name);
+        line(s.line);
+        varint(s.params.size());
+        for(Symbol param : s.params) symbol(param);
+        stmts(s.body);
+    }
+    void visitIfStmt(If& s) override {
+        byte(IF_STMT);
+        expr(s.condition);
+        stmt(s.thenBranch);
+        stmt(s.elseBranch);
+    }
+    void visitPrintStmt(Print& s) override {
+        byte(PRINT_STMT);
+        expr(s.expression);
+    }
+    void visitReturnStmt(Return& s) override {
+        byte(RETURN_STMT);
+        line(s.line);
+        expr(s.value);
+    }
+    void visitVarStmt(Var& s) override {
+        byte(VAR_STMT);
+        symbol(s.name);
+        line(s.line);
+        expr(s.initializer);
+    }
+    void visitWhileStmt(While& s) override {
+        byte(WHILE_STMT);
+        expr(s.condition);
+        stmt(s.body);
+        expr(s.increment);
+    }
+
+private:
+    std::unordered_map<Symbol, std::size_t> numbers;
+    unsigned int lastLine = 0;
+};
+
+/*
+** Rebuilds a Program from what Writer produced. Every read is bounds checked;
+** once anything is out of place, failed is set and the result is thrown away.
+*/
+class Reader {
+public:
+    Reader(std::string_view data, Program& program):
+        p(reinterpret_cast<const unsigned char*>(data.data())), end(p + data.size()),
+        program(program) {}
+
+    bool failed = false;
+
+    std::uint64_t varint() {
+        std::uint64_t n = 0;
+        for(int shift = 0; shift < 64; shift += 7)
+        {
+            if(p == end) break;
+            unsigned char b = *p++;
+            n |= std::uint64_t(b & 0x7f) << shift;
+            if(!(b & 0x80)) return n;
+        }
+        failed = true;
+        return 0;
+    }
+    unsigned char byte() {
+        if(p == end)
+        {
+            failed = true;
+            return 0;
+        }
+        return *p++;
+    }
+    std::string_view bytes(std::uint64_t n) {
+        if(n > std::uint64_t(end - p))
+        {
+            failed = true;
+            return std::string_view();
+        }
+        std::string_view s(reinterpret_cast<const char*>(p), n);
+        p += n;
+        return s;
+    }
+    bool atEnd() const {
+        return p == end;
+    }
+    std::string_view rest() const {
+        return std::string_view(reinterpret_cast<const char*>(p), end - p);
+    }
+
+    void readNames() {
+        std::uint64_t count = varint();
+        for(std::uint64_t i = 0; i < count && !failed; ++i)
+        {
+            std::string_view name = bytes(varint());
+            if(!failed) names.push_back(SymbolTable::intern(name));
+        }
+    }
+
+    /* only a few children may be missing, anywhere else a 0 tag is damage */
+    ExprPtr expr(bool optional = false) {
+        unsigned char tag = byte();
+        if(tag == 0 && !optional) failed = true;
+        if(tag == 0 || failed) return nullptr;
+        unsigned int line = readLine();
+        ExprPtr e = nullptr;
+        switch(tag)
+        {
+        case ASSIGN_EXPR: {
+            Symbol name = symbol();
+            e = make<Assign>(name, expr(), line);
+            break;
+        }
+        case BINARY_EXPR: {
+            Token op = oper(line);
+            ExprPtr left = expr();
+            e = make<Binary>(left, op, expr());
+            break;
+        }
+        case CALL_EXPR: {
+            ExprPtr callee = expr();
+            std::vector<ExprPtr> args(count());
+            for(ExprPtr& arg : args) arg = expr();
+            e = make<Call>(token(line), callee, program.arena.list(args));
+            break;
+        }
+        case GET_EXPR: {
+            Token name = token(line, symbol());
+            e = make<Get>(expr(), name);
+            break;
+        }
+        case GROUPING_EXPR: {
+            ExprPtr inner = expr();
+            if(!failed) e = make<Grouping>(inner);
+            break;
+        }
+        case LITERAL_EXPR:
+            e = literal();
+            break;
+        case LOGICAL_EXPR: {
+            Token op = oper(line);
+            ExprPtr left = expr();
+            e = make<Logical>(left, op, expr());
+            break;
+        }
+        case SET_EXPR: {
+            Symbol name = symbol();
+            ExprPtr object = expr();
+            e = make<Set>(object, name, expr(), line);
+            break;
+        }
+        case SUPER_EXPR:
+            e = make<Super>(token(line), token(line, symbol()));
+            break;
+        case THIS_EXPR:
+            e = make<This>(token(line));
+            break;
+        case UNARY_EXPR: {
+            Token op = oper(line);
+            e = make<Unary>(op, expr());
+            break;
+        }
+        case VARIABLE_EXPR:
+            e = make<Variable>(token(line, symbol()));
+            break;
+        default:
+            failed = true;
+        }
+        if(e == nullptr) failed = true;
+        else e->line = line;
+        return e;
+    }
+
+    StmtPtr stmt(bool optional = false) {
+        unsigned char tag = byte();
+        if(tag == 0 && !optional) failed = true;
+        if(tag == 0 || failed) return nullptr;
+        switch(tag)
+        {
+        case BLOCK_STMT: {
+            unsigned int line = readLine();
+            return make<Block>(stmts(), line);
+        }
+        case CLASS_STMT: {
+            Token name = named();
+            ExprPtr superclass = expr(true);
+            if(superclass != nullptr && dynamic_cast<Variable*>(superclass) == nullptr) failed = true;
+            std::vector<FunPtr> methods(count());
+            for(FunPtr& method : methods)
+            {
+                method = dynamic_cast<Function*>(stmt());
+                if(method == nullptr) failed = true;
+            }
+            return make<Class>(name, static_cast<Variable*>(superclass), program.arena.list(methods));
+        }
+        case EXPRESSION_STMT:
+            return make<Expression>(expr());
+        case FUNCTION_STMT: {
+            Token name = named();
+            std::vector<Symbol> params(count());
+            for(Symbol& param : params) param = symbol();
+            ArenaList<Symbol> list = program.arena.list(params);
+            return make<Function>(name, list, stmts());
+        }
+        case IF_STMT: {
+            ExprPtr condition = expr();
+            StmtPtr thenBranch = stmt();
+            return make<If>(condition, thenBranch, stmt(true));
+        }
+        case PRINT_STMT:
+            return make<Print>(expr());
+        case RETURN_STMT: {
+            Token keyword = token(readLine());
+            return make<Return>(keyword, expr(true));
+        }
+        case VAR_STMT: {
+            Token name = named();
+            return make<Var>(name, expr(true));
+        }
+        case WHILE_STMT: {
+            ExprPtr condition = expr();
+            StmtPtr body = stmt();
+            return make<While>(condition, body, expr(true));
+        }
+        case BREAK_STMT:
+            return make<Break>(token(readLine()));
+        case CONTINUE_STMT:
+            return make<Continue>(token(readLine()));
+        default:
+            failed = true;
+            return nullptr;
+        }
+    }
+
+    ArenaList<StmtPtr> stmts() {
+        std::vector<StmtPtr> list(count());
+        for(StmtPtr& s : list) s = stmt();
+        return program.arena.list(list);
+    }
+
+    /* an element count, which can't be more than the bytes left */
+    std::size_t count() {
+        std::uint64_t n = varint();
+        if(n > std::uint64_t(end - p))
+        {
+            failed = true;
+            return 0;
+        }
+        return n;
+    }
+
+private:
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        return program.arena.make<T>(std::forward<Args>(args)...);
+    }
+
+    Symbol symbol() {
+        std::uint64_t n = varint();
+        if(n >= names.size())
+        {
+            failed = true;
+            return 0;
+        }
+        return names[n];
+    }
+
+    /* the node constructors take Tokens, but only look at these fields */
+    static Token token(unsigned int line, Symbol symbol = 0) {
+        Token t(IDENTIFIER, "", 0, line);
+        t.symbol = symbol;
+        return t;
+    }
+    Token oper(unsigned int line) {
+        unsigned char type = byte();
+        if(type >= END_OF_FILE) failed = true;
+        Token t(static_cast<TokenType>(type), "", 0, line);
+        return t;
+    }
+    /* a declaration's name followed by its line */
+    Token named() {
+        Symbol name = symbol();
+        return token(readLine(), name);
+    }
+
+    ExprPtr literal() {
+        switch(byte())
+        {
+        case NIL_LITERAL:
+            return make<Literal>(nullptr);
+        case FALSE_LITERAL:
+            return make<Literal>(false);
+        case TRUE_LITERAL:
+            return make<Literal>(true);
+        case INTEGER_LITERAL:
+            return make<Literal>(static_cast<double>(varint()));
+        case NUMBER_LITERAL: {
+            std::uint64_t bits = 0;
+            for(int i = 0; i < 8; ++i) bits |= std::uint64_t(byte()) << (8 * i);
+            double d;
+            std::memcpy(&d, &bits, sizeof d);
+            return make<Literal>(d);
+        }
+        case STRING_LITERAL:
+            return make<Literal>(Value::string(std::string(bytes(varint()))));
+        default:
+            failed = true;
+            return nullptr;
+        }
+    }
+
+    unsigned int readLine() {
+        std::uint64_t n = varint();
+        std::int64_t delta = (n & 1) ? -std::int64_t(n >> 1) - 1 : std::int64_t(n >> 1);
+        lastLine = static_cast<unsigned int>(lastLine + delta);
+        return lastLine;
+    }
+
+    const unsigned char* p;
+    const unsigned char* end;
+    Program& program;
+    unsigned int lastLine = 0;
+    std::vector<Symbol> names;
+};
+
+void appendVarint(std::string& out, std::uint64_t n)
+{
+    while(n >= 0x80)
+    {
+        out.push_back(static_cast<char>(n | 0x80));
+        n >>= 7;
+    }
+    out.push_back(static_cast<char>(n));
+}
+
+/* like mkdir -p; an existing directory is fine */
+bool makeDirectories(const std::string& path)
+{
+    for(std::size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1))
+    {
+        std::string prefix = path.substr(0, slash);
+        if(mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) return false;
+        if(slash == std::string::npos) return true;
+    }
+}
+
+} // namespace
+
+
+std::string AstCache::defaultDirectory()
+{
+    if(const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg != nullptr && *xdg != '\0')
+        return std::string(xdg) + "/cpplox";
+    if(const char* home = std::getenv("HOME"); home != nullptr && *home != '\0')
+        return std::string(home) + "/.cache/cpplox";
+    return ".cpplox-cache";
+}
+
+/*
+** FNV-1a, but over 8 bytes at a time with a final avalanche so that hashing
+** a large script costs far less than scanning it did.
+*/
+std::uint64_t AstCache::hash(std::string_view text, std::uint64_t seed)
+{
+    const std::uint64_t PRIME = 0x100000001b3ULL;
+    std::uint64_t h = seed ^ 0xcbf29ce484222325ULL;
+    std::size_t i = 0;
+    for(; i + 8 <= text.size(); i += 8)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, text.data() + i, sizeof word);
+        h = (h ^ word) * PRIME;
+    }
+    for(; i < text.size(); ++i)
+        h = (h ^ static_cast<unsigned char>(text[i])) * PRIME;
+    h ^= text.size();
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+std::string AstCache::path(std::string_view source) const
+{
+    char name[32];
+    std::snprintf(name, sizeof name, "%016llx.ast",
+                  static_cast<unsigned long long>(hash(source, hash(STAMP, 0))));
+    return directory + "/" + name;
+}
+
+/*
+** An entry is the magic bytes, the stamp, the script's length and hash (to
+** tell apart scripts whose names collide), the hash of the rest, then the
+** names and the statements.
+*/
+std::unique_ptr<Program> AstCache::load(std::string_view source) const
+{
+    std::unique_ptr<Source> entry = Source::fromFile(path(source));
+    if(entry == nullptr) return nullptr;
+
+    std::string_view data = entry->text();
+    if(data.size() < sizeof MAGIC || data.compare(0, sizeof MAGIC, MAGIC, sizeof MAGIC) != 0)
+        return nullptr;
+    data.remove_prefix(sizeof MAGIC);
+
+    auto program = std::make_unique<Program>();
+    Reader reader(data, *program);
+    if(reader.bytes(reader.varint()) != STAMP) return nullptr;
+    if(reader.varint() != source.size()) return nullptr;
+    if(reader.varint() != hash(source, 0)) return nullptr;
+    std::uint64_t checksum = reader.varint();
+    if(reader.failed || hash(reader.rest(), 0) != checksum) return nullptr;
+
+    reader.readNames();
+    std::size_t count = reader.count();
+    program->statements.reserve(count);
+    for(std::size_t i = 0; i < count && !reader.failed; ++i)
+        program->statements.push_back(reader.stmt());
+
+    if(reader.failed || !reader.atEnd()) return nullptr;
+    return program;
+}
+
+void AstCache::store(std::string_view source, const Program& program) const
+{
+    Writer writer;
+    writer.varint(program.statements.size());
+    for(StmtPtr s : program.statements) writer.stmt(s);
+
+    std::string payload;
+    appendVarint(payload, writer.names.size());
+    for(Symbol s : writer.names)
+    {
+        const std::string& name = SymbolTable::name(s);
+        appendVarint(payload, name.size());
+        payload += name;
+    }
+    payload += writer.nodes;
+
+    std::string out(MAGIC, sizeof MAGIC);
+    appendVarint(out, STAMP.size());
+    out += STAMP;
+    appendVarint(out, source.size());
+    appendVarint(out, hash(source, 0));
+    appendVarint(out, hash(payload, 0));
+    out += payload;
+
+    if(!makeDirectories(directory)) return;
+    std::string target = path(source);
+    std::string temporary = target + "." + std::to_string(getpid());
+    std::FILE* f = std::fopen(temporary.c_str(), "wb");
+    if(f == nullptr) return;
+    bool written = std::fwrite(out.data(), 1, out.size(), f) == out.size();
+    if(std::fclose(f) != 0) written = false;
+    if(!written || std::rename(temporary.c_str(), target.c_str()) != 0)
+        std::remove(temporary.c_str());
+}
+
+} // namespace lox
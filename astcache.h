@@ -0,0 +1,56 @@
+#ifndef LOX_ASTCACHE_H
+#define LOX_ASTCACHE_H
+
+#include<cstdint>
+#include<memory>
+#include<string>
+#include<string_view>
+
+#include"stmt.h"
+
+namespace lox
+{
+
+/*
+** An on-disk cache of parsed Programs, so that running the same script again
+** skips the Scanner and Parser entirely.
+**
+** Entries are named after a hash of the script's text and of FORMAT_VERSION
+** and the C++ compiler that built us, and hold a compact pre-order encoding
+** of the tree: one tag byte per node, varints for lines, counts and names.
+** Names are written once each as text and interned again on load, since
+** Symbols are only meaningful within one run. The node payload doesn't refer
+** back to the script at all, so a hit only needs the script for its hash.
+**
+** Bump FORMAT_VERSION whenever the encoding or the Parser's output for the
+** same text changes. The names and nodes are hashed too, since a damaged
+** byte among them could still decode, as a different tree. A stale,
+** truncated, damaged or otherwise unreadable entry is just a miss, and entries are written to a temporary file and renamed into place
+** so concurrent runs never see half of one.
+*/
+class AstCache {
+public:
+    static constexpr unsigned int FORMAT_VERSION = 4;
+
+    /* entries go in directory, which is created on the first store() */
+    explicit AstCache(std::string directory): directory(std::move(directory)) {}
+    AstCache(const AstCache&) = delete;
+
+    /* $XDG_CACHE_HOME/cpplox, else ~/.cache/cpplox */
+    static std::string defaultDirectory();
+
+    /* returns nullptr on a miss */
+    std::unique_ptr<Program> load(std::string_view source) const;
+    /* failing to write is not an error, the next run just misses again */
+    void store(std::string_view source, const Program& program) const;
+
+private:
+    static std::uint64_t hash(std::string_view text, std::uint64_t seed);
+    std::string path(std::string_view source) const;
+
+    std::string directory;
+};
+
+} // namespace lox
+
+#endif
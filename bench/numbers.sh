@@ -0,0 +1,26 @@
+#!/bin/sh
+# Writes a table of numeric literals to stdout, about 18MB for the default
+# 200000 rows: each row a var declared as a comma expression of integers
+# and signed decimals. Mostly it times the Scanner's number parsing.
+# Usage: bench/numbers.sh [rows] > bench/numbers.lox
+awk -v rows="${1:-200000}" '
+# Park-Miller, whose products stay exact in awks that only have doubles
+function next_random() {
+    seed = (seed * 16807) % 2147483647
+    return seed
+}
+BEGIN {
+    seed = 1
+    for(row = 0; row < rows; ++row)
+    {
+        line = "var t" row " = "
+        for(column = 0; column < 4; ++column)
+        {
+            if(column > 0) line = line ", "
+            line = line (next_random() % 100000) ", "
+            decimal = (next_random() % 2000000000 - 1000000000) / 1000000
+            line = line sprintf("%.6f", decimal)
+        }
+        print line ";"
+    }
+}'
@@ -0,0 +1,24 @@
+#!/bin/bash
+# Times every script in bench/ with the given cpplox on each engine that
+# can run it, printing the best of three runs.
+# Usage: bench/run.sh ./cpplox-bench [script...]
+lox=${1:-./cpplox}
+shift
+dir=$(dirname "$0")
+scripts=${*:-$dir/*.lox}
+TIMEFORMAT=%R
+
+for script in $scripts; do
+    for engine in tree vm closure; do
+        if $lox --engine=$engine "$script" 2>&1 >/dev/null | grep -q "only supported by --engine=tree"; then
+            printf '%-24s %-8s unsupported\n' "$(basename "$script")" $engine
+            continue
+        fi
+        best=
+        for run in 1 2 3; do
+            t=$( { time $lox --engine=$engine "$script" > /dev/null 2>&1; } 2>&1 )
+            if [ -z "$best" ] || awk "BEGIN { exit !($t < $best) }"; then best=$t; fi
+        done
+        printf '%-24s %-8s %ss\n' "$(basename "$script")" $engine "$best"
+    done
+done
@@ -0,0 +1,19 @@
+#!/bin/sh
+# Writes a script of mixed statements to stdout, 100000 of them by default:
+# declarations, ifs, whiles and fors over nested expressions and blocks.
+# The globals make every loop but the first end at once, so running it
+# mostly times the Scanner, the Parser and freeing the tree.
+# Usage: bench/statements.sh [statements] > bench/statements.lox
+awk -v count="${1:-100000}" '
+BEGIN {
+    print "var b = 1; var c = 2; var d = 3; var e = 4; var f = 5; var g = 6;"
+    print "var i = 0; var n = 0; var x; var y; var z = \"z\";"
+    for(k = 0; k < count; k += 4)
+    {
+        print "var a" k " = (" k " + b * c - d / 2) * (e + f) == g;"
+        print "if (a" k " and b < 4) { print a" k " + \"x\"; } else { x = y = z; }"
+        print "while (i < 10) { i = i + 1; { var t = -i; } }"
+        print "for (var j = 0; j < n; j = j + 1) print !(j == 2) or nil;"
+    }
+    print "print x;"
+}'
@@ -0,0 +1,37 @@
+#include<chrono>
+
+#include"callable.h"
+#include"environment.h"
+#include"interpreter.h"
+#include"stmt.h"
+#include"symbol.h"
+
+namespace lox {
+
+unsigned int LoxFunction::arity() const
+{
+    return declaration.params.size();
+}
+
+Value LoxFunction::call(Interpreter& interpreter, Environment& frame, unsigned int line)
+{
+    return interpreter.callFunction(*this, frame, line);
+}
+
+std::string LoxFunction::toString() const
+{
+    return "<fn " + SymbolTable::name(declaration.name) + ">";
+}
+
+Value NativeFunction::call(Interpreter& interpreter, Environment& frame, unsigned int line)
+{
+    return body(&frame.at(0, 0));
+}
+
+Value clockNative(const Value* args)
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace lox
@@ -0,0 +1,114 @@
+#ifndef LOX_CALLABLE_H
+#define LOX_CALLABLE_H
+
+#include<string>
+#include<vector>
+
+#include"value.h"
+
+namespace lox {
+
+class Environment;
+class Function;
+class Interpreter;
+
+/*
+** Anything a Lox program can call. The Interpreter evaluates a call's
+** arguments straight into a frame on its FrameStack and checks there are
+** arity() of them, so call() finds them in the first slots of frame.
+*/
+class LoxCallable : public Obj {
+public:
+    virtual ~LoxCallable() = default;
+
+    virtual unsigned int arity() const = 0;
+    /* line is that of the call, for errors */
+    virtual Value call(Interpreter& interpreter, Environment& frame, unsigned int line) = 0;
+    virtual std::string toString() const = 0;
+
+protected:
+    /* not referred to by any Value yet, see Value::object() */
+    explicit LoxCallable(ObjType type) {
+        this->type = type;
+        refs = 0;
+    }
+};
+
+/*
+** A variable moved off the FrameStack because a closure that may outlive
+** its scope captures it. The scope's slot holds the Cell, and the closure
+** a reference to it.
+*/
+class Cell : public Obj {
+public:
+    explicit Cell(Value value): value(std::move(value)) {
+        type = ObjType::CELL;
+        refs = 0;
+    }
+
+    Value value;
+};
+
+/*
+** A function declared in a Program, which must outlive it, together with
+** the variables of enclosing functions it uses. Each is reached through a
+** pointer: into a Cell, which the closure keeps alive, or, when the Resolver
+** has shown that the closure is never used after the variable's scope ends,
+** straight into the variable's slot on the FrameStack.
+*/
+class LoxFunction : public LoxCallable {
+public:
+    struct Upvalue {
+        Value* value;
+        /* the Cell value points into, or nil */
+        Value cell;
+    };
+
+    explicit LoxFunction(Function& declaration):
+        LoxCallable(ObjType::FUNCTION), declaration(declaration) {}
+
+    unsigned int arity() const override;
+    Value call(Interpreter& interpreter, Environment& frame, unsigned int line) override;
+    std::string toString() const override;
+
+    Function& declaration;
+    /* in the order of the declaration's captures */
+    std::vector<Upvalue> upvalues;
+    /* whether it is a class's init method, which gives back the instance it ran on */
+    bool initializer = false;
+};
+
+/*
+** A function built into the interpreter, such as clock(). Its body gets the
+** arguments as an array, which is how both the Interpreter's frames and the
+** VM's stack hold them.
+*/
+class NativeFunction : public LoxCallable {
+public:
+    typedef Value (*Body)(const Value* args);
+
+    NativeFunction(unsigned int arity, Body body):
+        LoxCallable(ObjType::NATIVE), params(arity), body(body) {}
+
+    unsigned int arity() const override {
+        return params;
+    }
+    Value call(Interpreter& interpreter, Environment& frame, unsigned int line) override;
+    Value invoke(const Value* args) const {
+        return body(args);
+    }
+    std::string toString() const override {
+        return "<native fn>";
+    }
+
+private:
+    unsigned int params;
+    Body body;
+};
+
+/* seconds since some fixed point, for timing things */
+Value clockNative(const Value* args);
+
+} // namespace lox
+
+#endif
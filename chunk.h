@@ -0,0 +1,128 @@
+#ifndef LOX_CHUNK_H
+#define LOX_CHUNK_H
+
+#include<algorithm>
+#include<cstdint>
+#include<cstring>
+#include<string>
+#include<utility>
+#include<vector>
+
+#include"symbol.h"
+#include"value.h"
+
+namespace lox {
+
+/*
+** The instruction set of the VM. Operands follow the opcode: slots, symbols
+** and constant indices as varints (one byte below 128), jump distances as
+** 4 bytes so they can be patched once the target is known.
+*/
+enum OpCode : std::uint8_t {
+    OP_CONSTANT,        /* index: push constants[index] */
+    OP_NIL,
+    OP_TRUE,
+    OP_FALSE,
+    OP_POP,
+    OP_POPN,            /* count */
+    OP_GET_LOCAL,       /* slot */
+    OP_SET_LOCAL,       /* slot, leaves the value on the stack */
+    OP_GET_GLOBAL,      /* symbol */
+    OP_DEFINE_GLOBAL,   /* symbol */
+    OP_SET_GLOBAL,      /* symbol, leaves the value on the stack */
+    OP_GET_CALLEE,      /* push the function running */
+    OP_EQUAL,
+    OP_GREATER,
+    OP_GREATER_EQUAL,
+    OP_LESS,
+    OP_LESS_EQUAL,
+    OP_ADD,
+    OP_SUBTRACT,
+    OP_MULTIPLY,
+    OP_DIVIDE,
+    OP_NOT,
+    OP_NEGATE,
+    OP_PRINT,
+    OP_JUMP,            /* distance forward */
+    OP_JUMP_IF_FALSE,   /* distance forward, doesn't pop the condition */
+    OP_JUMP_IF_TRUE,    /* distance forward, doesn't pop the condition */
+    OP_LOOP,            /* distance back */
+    OP_CALL,            /* count: calls the value below the count arguments */
+    OP_OVERFLOW,        /* a block whose locals don't fit on the stack */
+    OP_RETURN           /* from a function with the value on top, or ends the Program */
+};
+
+/*
+** The compiled form of one Program or function: its code, the constants it
+** refers to and which source line each instruction came from, for error
+** reports.
+*/
+class Chunk {
+public:
+    std::vector<std::uint8_t> code;
+    std::vector<Value> constants;
+    /* the most values, locals included, the code has on the stack at once */
+    std::size_t maxStack = 0;
+
+    void write(std::uint8_t byte, unsigned int line) {
+        if(lines.empty() || lines.back().second != line) lines.emplace_back(code.size(), line);
+        code.push_back(byte);
+    }
+    void writeOperand(std::uint32_t n, unsigned int line) {
+        while(n >= 0x80)
+        {
+            write(static_cast<std::uint8_t>(n | 0x80), line);
+            n >>= 7;
+        }
+        write(static_cast<std::uint8_t>(n), line);
+    }
+    /* writes a placeholder jump distance and returns where to patch it */
+    std::size_t writeJump(unsigned int line) {
+        for(int i = 0; i < 4; ++i) write(0, line);
+        return code.size() - 4;
+    }
+    void patchJump(std::size_t at, std::uint32_t distance) {
+        std::memcpy(&code[at], &distance, sizeof distance);
+    }
+    std::size_t addConstant(Value value) {
+        constants.push_back(std::move(value));
+        return constants.size() - 1;
+    }
+
+    /* the line of the instruction that offset is in */
+    unsigned int lineAt(std::size_t offset) const {
+        auto it = std::upper_bound(lines.begin(), lines.end(), std::make_pair(offset, ~0u));
+        return it == lines.begin() ? 0 : std::prev(it)->second;
+    }
+
+private:
+    /* run-length encoded: the line from each offset on, until the next entry */
+    std::vector<std::pair<std::size_t, unsigned int>> lines;
+};
+
+/*
+** A function compiled for the VM. Its parameters are its first locals, so
+** a call leaves the arguments where they are on the stack and runs the
+** chunk with its frame starting at the first of them. Functions declared
+** inside it are among its constants.
+*/
+class CompiledFunction : public Obj {
+public:
+    CompiledFunction(Symbol name, unsigned int arity): name(name), arity(arity) {
+        type = ObjType::COMPILED;
+        refs = 0;
+    }
+    CompiledFunction(const CompiledFunction&) = delete;
+
+    std::string toString() const {
+        return "<fn " + SymbolTable::name(name) + ">";
+    }
+
+    Symbol name;
+    unsigned int arity;
+    Chunk chunk;
+};
+
+} // namespace lox
+
+#endif
@@ -0,0 +1,533 @@
+#include<algorithm>
+
+#include"callable.h"
+#include"closurecompiler.h"
+#include"environment.h"
+#include"lox.h"
+#include"runtimeerror.h"
+
+namespace lox {
+
+namespace {
+
+typedef ClosureCompiler::ExprCode ExprCode;
+
+/* a binary operator on two numbers, e.g. std::minus */
+template<typename Op>
+ExprCode numeric(ExprCode left, ExprCode right, unsigned int line, Op op)
+{
+    return [left = std::move(left), right = std::move(right), line, op](Value* fp) -> Value {
+        Value a = left(fp);
+        Value b = right(fp);
+        if(!a.isNumber() || !b.isNumber()) throw RuntimeError(line, "Operand must be a number.");
+        return op(a.asNumber(), b.asNumber());
+    };
+}
+
+std::string arityError(unsigned int arity, unsigned int count)
+{
+    return "Expected " + std::to_string(arity) + " arguments but got " + std::to_string(count) + ".";
+}
+
+} // namespace
+
+/* as many slots as the Interpreter's FrameStack, and its natives */
+ClosureCompiler::ClosureCompiler(): stack(FrameStack::DEFAULT_SLOTS)
+{
+    Global& clock = global(SymbolTable::intern("clock"));
+    clock.value = Value::object(new NativeFunction(0, clockNative));
+    clock.defined = true;
+}
+
+void ClosureCompiler::execute(const std::vector<StmtPtr>& statements)
+{
+    std::vector<StmtCode> code;
+    code.reserve(statements.size());
+    for(StmtPtr s : statements) code.push_back(compile(s));
+    if(reported)
+    {
+        reported = false;
+        return;
+    }
+
+    try {
+        for(const StmtCode& s : code) s(stack.data());
+    }
+    catch(const RuntimeError& err)
+    {
+        /* let go of whatever the frames being run still held */
+        for(Value& slot : stack) slot = nullptr;
+        returned = nullptr;
+        depth = 0;
+        Lox::runtimeError(err);
+    }
+}
+
+ClosureCompiler::ExprCode ClosureCompiler::compile(ExprPtr node)
+{
+    node->accept(*this);
+    return std::move(expr);
+}
+
+ClosureCompiler::StmtCode ClosureCompiler::compile(StmtPtr node)
+{
+    node->accept(*this);
+    return std::move(stmt);
+}
+
+void ClosureCompiler::unsupported(const std::string& what, unsigned int line)
+{
+    if(reported) return;
+    Lox::error(line, what + " are only supported by --engine=tree.");
+    reported = true;
+}
+
+unsigned int ClosureCompiler::local(unsigned int depth, unsigned int slot) const
+{
+    /* captured variables only come with closures, so code using them is never run */
+    if(depth >= BOXED) return 0;
+    return scopes[scopes.size() - 1 - depth] + slot;
+}
+
+/*
+** The frame is checked against the end of the stack and the call depth
+** against the Interpreter's limit, so a runaway recursion fails as it does
+** there. The callee's locals are cleared on the way out; a block inside
+** clears its own.
+*/
+Value ClosureCompiler::call(const Value& callee, Value* frame, unsigned int count, unsigned int line)
+{
+    if(callee.isCode())
+    {
+        CodeFunction* function = static_cast<CodeFunction*>(callee.asObj());
+        if(count != function->arity) throw RuntimeError(line, arityError(function->arity, count));
+        if(depth == Interpreter::MAX_CALL_DEPTH ||
+           function->frame > static_cast<std::size_t>(stack.data() + stack.size() - frame))
+            throw RuntimeError(line, "Stack overflow.");
+
+        ++depth;
+        Completion completion = Completion::NORMAL;
+        for(const StmtCode& s : function->body)
+        {
+            if((completion = s(frame)) != Completion::NORMAL) break;
+        }
+        --depth;
+        for(unsigned int i = 0; i < function->locals; ++i) frame[i] = nullptr;
+
+        if(completion != Completion::RETURN) return nullptr;
+        return std::move(returned);
+    }
+    if(callee.isObj() && callee.asObj()->type == ObjType::NATIVE)
+    {
+        NativeFunction* native = static_cast<NativeFunction*>(callee.asObj());
+        if(count != native->arity()) throw RuntimeError(line, arityError(native->arity(), count));
+        Value result = native->invoke(frame);
+        for(unsigned int i = 0; i < count; ++i) frame[i] = nullptr;
+        return result;
+    }
+    throw RuntimeError(line, "Can only call functions and classes.");
+}
+
+ClosureCompiler::Global& ClosureCompiler::defined(Symbol name, unsigned int line)
+{
+    if(name >= globals.size() || !globals[name].defined)
+        throw RuntimeError(line, "Undefined Identifier '" + SymbolTable::name(name) + "' .");
+    return globals[name];
+}
+
+Value ClosureCompiler::visitAssignExpr(Assign& node)
+{
+    ExprCode value = compile(node.value);
+    unsigned int line = node.line;
+
+    if(node.depth == GLOBAL)
+    {
+        expr = [this, value = std::move(value), name = node.name, line](Value* fp) -> Value {
+            Value v = value(fp);
+            defined(name, line).value = v;
+            return v;
+        };
+    }
+    else
+    {
+        expr = [value = std::move(value), slot = local(node.depth, node.slot)](Value* fp) -> Value {
+            fp[slot] = value(fp);
+            return fp[slot];
+        };
+    }
+    return nullptr;
+}
+
+Value ClosureCompiler::visitBinaryExpr(Binary& node)
+{
+    ExprCode left = compile(node.left);
+    ExprCode right = compile(node.right);
+    unsigned int line = node.line;
+
+    switch(node.oper)
+    {
+    case PLUS:
+        expr = [left = std::move(left), right = std::move(right), line](Value* fp) -> Value {
+            Value a = left(fp);
+            Value b = right(fp);
+            if(a.isNumber() && b.isNumber()) return a.asNumber() + b.asNumber();
+            if(a.isString() && b.isString()) return Value::concatenate(std::move(a), b);
+            throw RuntimeError(line, "Operands must be two numbers or two strings.");
+        };
+        break;
+    case MINUS:         expr = numeric(std::move(left), std::move(right), line, std::minus<double>()); break;
+    case STAR:          expr = numeric(std::move(left), std::move(right), line, std::multiplies<double>()); break;
+    case SLASH:         expr = numeric(std::move(left), std::move(right), line, std::divides<double>()); break;
+    case GREATER:       expr = numeric(std::move(left), std::move(right), line, std::greater<double>()); break;
+    case GREATER_EQUAL: expr = numeric(std::move(left), std::move(right), line, std::greater_equal<double>()); break;
+    case LESS:          expr = numeric(std::move(left), std::move(right), line, std::less<double>()); break;
+    case LESS_EQUAL:    expr = numeric(std::move(left), std::move(right), line, std::less_equal<double>()); break;
+    case EQUAL_EQUAL:
+        expr = [left = std::move(left), right = std::move(right)](Value* fp) -> Value {
+            Value a = left(fp);
+            return a == right(fp);
+        };
+        break;
+    case BANG_EQUAL:
+        expr = [left = std::move(left), right = std::move(right)](Value* fp) -> Value {
+            Value a = left(fp);
+            return !(a == right(fp));
+        };
+        break;
+    case COMMA:
+        expr = [left = std::move(left), right = std::move(right)](Value* fp) -> Value {
+            left(fp);
+            return right(fp);
+        };
+        break;
+    default:
+        /* the Interpreter gives nil for an operator it doesn't know */
+        expr = [left = std::move(left), right = std::move(right)](Value* fp) -> Value {
+            left(fp);
+            right(fp);
+            return nullptr;
+        };
+        break;
+    }
+    return nullptr;
+}
+
+/*
+** The callee and then each argument go in the next free slots of the
+** frame, so a call made while working one out gets the slots after it.
+** The callee's frame starts with the arguments, and has the function just
+** below it, as on the VM's stack.
+*/
+Value ClosureCompiler::visitCallExpr(Call& node)
+{
+    unsigned int base = locals++;
+    ExprCode callee = compile(node.callee);
+    std::vector<ExprCode> args;
+    for(ExprPtr arg : node.args)
+    {
+        args.push_back(compile(arg));
+        ++locals;
+    }
+    frameSize = std::max(frameSize, locals);
+    locals = base;
+
+    expr = [this, callee = std::move(callee), args = std::move(args), base, line = node.line](Value* fp) -> Value {
+        fp[base] = callee(fp);
+        Value* frame = fp + base + 1;
+        for(std::size_t i = 0; i < args.size(); ++i) frame[i] = args[i](fp);
+        Value result = call(fp[base], frame, args.size(), line);
+        fp[base] = nullptr;
+        return result;
+    };
+    return nullptr;
+}
+
+Value ClosureCompiler::visitGetExpr(Get& node)
+{
+    unsupported("Classes", node.line);
+    expr = [](Value* fp) -> Value { return nullptr; };
+    return nullptr;
+}
+
+Value ClosureCompiler::visitGroupingExpr(Grouping& node)
+{
+    expr = compile(node.expr);
+    return nullptr;
+}
+
+Value ClosureCompiler::visitLiteralExpr(Literal& node)
+{
+    expr = [value = node.value](Value* fp) -> Value { return value; };
+    return nullptr;
+}
+
+Value ClosureCompiler::visitLogicalExpr(Logical& node)
+{
+    ExprCode left = compile(node.left);
+    ExprCode right = compile(node.right);
+
+    if(node.oper == OR)
+    {
+        expr = [left = std::move(left), right = std::move(right)](Value* fp) -> Value {
+            Value a = left(fp);
+            if(a.isTruthy()) return a;
+            return right(fp);
+        };
+    }
+    else
+    {
+        expr = [left = std::move(left), right = std::move(right)](Value* fp) -> Value {
+            Value a = left(fp);
+            if(!a.isTruthy()) return a;
+            return right(fp);
+        };
+    }
+    return nullptr;
+}
+
+Value ClosureCompiler::visitSetExpr(Set& node)
+{
+    unsupported("Classes", node.line);
+    expr = [](Value* fp) -> Value { return nullptr; };
+    return nullptr;
+}
+
+Value ClosureCompiler::visitSuperExpr(Super& node)
+{
+    expr = [](Value* fp) -> Value { return nullptr; };
+    return nullptr;
+}
+
+Value ClosureCompiler::visitThisExpr(This& node)
+{
+    unsupported("Classes", node.line);
+    expr = [](Value* fp) -> Value { return nullptr; };
+    return nullptr;
+}
+
+Value ClosureCompiler::visitUnaryExpr(Unary& node)
+{
+    ExprCode right = compile(node.right);
+    unsigned int line = node.line;
+
+    switch(node.oper)
+    {
+    case MINUS:
+        expr = [right = std::move(right), line](Value* fp) -> Value {
+            Value v = right(fp);
+            if(!v.isNumber()) throw RuntimeError(line, "Operand must be a number.");
+            return -v.asNumber();
+        };
+        break;
+    case BANG:
+        expr = [right = std::move(right)](Value* fp) -> Value { return !right(fp).isTruthy(); };
+        break;
+    default:
+        expr = [right = std::move(right)](Value* fp) -> Value {
+            right(fp);
+            return nullptr;
+        };
+        break;
+    }
+    return nullptr;
+}
+
+Value ClosureCompiler::visitVariableExpr(Variable& node)
+{
+    if(node.depth == GLOBAL)
+        expr = [this, name = node.name, line = node.line](Value* fp) -> Value { return defined(name, line).value; };
+    else if(node.depth == CALLEE)
+        expr = [](Value* fp) -> Value { return fp[-1]; };
+    else
+        expr = [slot = local(node.depth, node.slot)](Value* fp) -> Value { return fp[slot]; };
+    return nullptr;
+}
+
+/*
+** The locals in scope never change at run time, so, as in the Compiler, a
+** block whose function's frame would alone be past the Interpreter's
+** FrameStack limit is known here and becomes the error it would raise on
+** entry. call() checks the rest.
+*/
+void ClosureCompiler::visitBlockStmt(Block& node)
+{
+    if(locals + node.slots > FrameStack::DEFAULT_SLOTS)
+    {
+        stmt = [line = node.line](Value* fp) -> Completion { throw RuntimeError(line, "Stack overflow."); };
+        return;
+    }
+
+    scopes.push_back(locals);
+    std::vector<StmtCode> body;
+    for(StmtPtr s : node.statements) body.push_back(compile(s));
+    unsigned int first = scopes.back();
+    unsigned int count = locals - first;
+    scopes.pop_back();
+    locals -= count;
+
+    stmt = [body = std::move(body), first, count](Value* fp) {
+        Completion completion = Completion::NORMAL;
+        for(const StmtCode& s : body)
+        {
+            if((completion = s(fp)) != Completion::NORMAL) break;
+        }
+        for(unsigned int i = 0; i < count; ++i) fp[first + i] = nullptr;
+        return completion;
+    };
+}
+
+void ClosureCompiler::visitBreakStmt(Break& node)
+{
+    stmt = [](Value* fp) { return Completion::BREAK; };
+}
+
+void ClosureCompiler::visitClassStmt(Class& node)
+{
+    unsupported("Classes", node.line);
+    stmt = [](Value* fp) { return Completion::NORMAL; };
+}
+
+void ClosureCompiler::visitContinueStmt(Continue& node)
+{
+    stmt = [](Value* fp) { return Completion::CONTINUE; };
+}
+
+void ClosureCompiler::visitExpressionStmt(Expression& node)
+{
+    stmt = [expression = compile(node.expression)](Value* fp) {
+        expression(fp);
+        return Completion::NORMAL;
+    };
+}
+
+/*
+** The function is made here, as the VM's are made by the Compiler, and its
+** body is compiled as if it were alone in the Program, with the arguments
+** as the first locals. A declaration then defines it like a var.
+*/
+void ClosureCompiler::visitFunctionStmt(Function& node)
+{
+    if(!node.captures.empty()) unsupported("Closures", node.line);
+
+    CodeFunction* function = new CodeFunction(node.name, node.params.size());
+    Value value = Value::object(function);
+
+    std::vector<unsigned int> enclosing(1, 0);
+    std::swap(scopes, enclosing);
+    unsigned int enclosingLocals = locals;
+    unsigned int enclosingFrame = frameSize;
+    locals = frameSize = function->arity;
+    for(StmtPtr s : node.body) function->body.push_back(compile(s));
+    function->locals = locals;
+    function->frame = frameSize;
+    scopes = std::move(enclosing);
+    locals = enclosingLocals;
+    frameSize = enclosingFrame;
+
+    if(scopes.empty())
+    {
+        stmt = [this, value = std::move(value), name = node.name](Value* fp) {
+            Global& g = global(name);
+            g.value = value;
+            g.defined = true;
+            return Completion::NORMAL;
+        };
+        return;
+    }
+
+    unsigned int slot = locals++;
+    frameSize = std::max(frameSize, locals);
+    stmt = [value = std::move(value), slot](Value* fp) {
+        fp[slot] = value;
+        return Completion::NORMAL;
+    };
+}
+
+void ClosureCompiler::visitIfStmt(If& node)
+{
+    ExprCode condition = compile(node.condition);
+    StmtCode thenBranch = compile(node.thenBranch);
+
+    if(node.elseBranch == nullptr)
+    {
+        stmt = [condition = std::move(condition), thenBranch = std::move(thenBranch)](Value* fp) {
+            if(condition(fp).isTruthy()) return thenBranch(fp);
+            return Completion::NORMAL;
+        };
+        return;
+    }
+
+    StmtCode elseBranch = compile(node.elseBranch);
+    stmt = [condition = std::move(condition), thenBranch = std::move(thenBranch),
+            elseBranch = std::move(elseBranch)](Value* fp) {
+        if(condition(fp).isTruthy()) return thenBranch(fp);
+        return elseBranch(fp);
+    };
+}
+
+void ClosureCompiler::visitPrintStmt(Print& node)
+{
+    stmt = [expression = compile(node.expression)](Value* fp) {
+        Interpreter::print(expression(fp));
+        return Completion::NORMAL;
+    };
+}
+
+void ClosureCompiler::visitReturnStmt(Return& node)
+{
+    ExprCode value;
+    if(node.value != nullptr) value = compile(node.value);
+    else value = [](Value* fp) -> Value { return nullptr; };
+
+    stmt = [this, value = std::move(value)](Value* fp) {
+        returned = value(fp);
+        return Completion::RETURN;
+    };
+}
+
+void ClosureCompiler::visitVarStmt(Var& node)
+{
+    ExprCode initializer;
+    if(node.initializer != nullptr) initializer = compile(node.initializer);
+    else initializer = [](Value* fp) -> Value { return nullptr; };
+
+    if(scopes.empty())
+    {
+        stmt = [this, initializer = std::move(initializer), name = node.name](Value* fp) {
+            Value value = initializer(fp);
+            Global& g = global(name);
+            g.value = std::move(value);
+            g.defined = true;
+            return Completion::NORMAL;
+        };
+        return;
+    }
+
+    unsigned int slot = locals++;
+    frameSize = std::max(frameSize, locals);
+    stmt = [initializer = std::move(initializer), slot](Value* fp) {
+        fp[slot] = initializer(fp);
+        return Completion::NORMAL;
+    };
+}
+
+void ClosureCompiler::visitWhileStmt(While& node)
+{
+    ExprCode condition = compile(node.condition);
+    StmtCode body = compile(node.body);
+    ExprCode increment;
+    if(node.increment != nullptr) increment = compile(node.increment);
+
+    stmt = [condition = std::move(condition), body = std::move(body), increment = std::move(increment)](Value* fp) {
+        while(condition(fp).isTruthy())
+        {
+            Completion completion = body(fp);
+            if(completion == Completion::BREAK) break;
+            if(completion == Completion::RETURN) return completion;
+            if(increment) increment(fp);
+        }
+        return Completion::NORMAL;
+    };
+}
+
+} // namespace lox
@@ -0,0 +1,147 @@
+#ifndef LOX_CLOSURECOMPILER_H
+#define LOX_CLOSURECOMPILER_H
+
+#include<functional>
+#include<string>
+#include<vector>
+
+#include"expr.h"
+#include"interpreter.h"
+#include"stmt.h"
+#include"symbol.h"
+#include"value.h"
+
+namespace lox {
+
+/*
+** The third way of running a Program: the tree is walked once, turning
+** every node into a C++ closure that already knows what it does, and the
+** closures are then called instead. `a - b` becomes a lambda for
+** subtraction holding the closures for a and b, so running it makes no
+** visitor calls and doesn't switch on the operator again. A local variable
+** is bound to its index in the frame, and a global to its Symbol.
+**
+** Every closure is passed the base of the frame it runs in. Locals live on
+** one stack of Values, each scope's in declaration order after those of the
+** scopes around it, as in the VM. A call stores the function and its
+** arguments after the slots its caller is using, and the arguments become
+** the first locals of the callee's frame, so a function called again before it returned, as any
+** recursion is, runs the same closures on a frame of its own. Globals are
+** indexed by Symbol and stay defined between the lines of the REPL.
+**
+** A statement's closure returns its Completion, as executing it in the
+** Interpreter does, which is how a loop learns of a break or continue and
+** a call of a return, whose value is left in returned.
+**
+** It leaves closures and classes to the Interpreter and reports a Program
+** that uses them as an error.
+*/
+class ClosureCompiler : public ExprVisitor, public StmtVisitor {
+public:
+    typedef std::function<Value(Value* fp)> ExprCode;
+    typedef std::function<Completion(Value* fp)> StmtCode;
+
+    ClosureCompiler();
+    ClosureCompiler(const ClosureCompiler&) = delete;
+
+    /* compiles and runs statements, reporting a runtime error through Lox */
+    void execute(const std::vector<StmtPtr>& statements);
+
+    Value visitAssignExpr(Assign& expr) override;
+    Value visitBinaryExpr(Binary& expr) override;
+    Value visitCallExpr(Call& expr) override;
+    Value visitGetExpr(Get& expr) override;
+    Value visitGroupingExpr(Grouping& expr) override;
+    Value visitLiteralExpr(Literal& expr) override;
+    Value visitLogicalExpr(Logical& expr) override;
+    Value visitSetExpr(Set& expr) override;
+    Value visitSuperExpr(Super& expr) override;
+    Value visitThisExpr(This& expr) override;
+    Value visitUnaryExpr(Unary& expr) override;
+    Value visitVariableExpr(Variable& expr) override;
+
+    void visitBlockStmt(Block& stmt) override;
+    void visitBreakStmt(Break& stmt) override;
+    void visitClassStmt(Class& stmt) override;
+    void visitContinueStmt(Continue& stmt) override;
+    void visitExpressionStmt(Expression& stmt) override;
+    void visitFunctionStmt(Function& stmt) override;
+    void visitIfStmt(If& stmt) override;
+    void visitPrintStmt(Print& stmt) override;
+    void visitReturnStmt(Return& stmt) override;
+    void visitVarStmt(Var& stmt) override;
+    void visitWhileStmt(While& stmt) override;
+
+private:
+    struct Global {
+        Value value;
+        bool defined = false;
+    };
+
+    ExprCode compile(ExprPtr expr);
+    StmtCode compile(StmtPtr stmt);
+    /* the index in the frame of a local the Resolver gave (depth, slot) */
+    unsigned int local(unsigned int depth, unsigned int slot) const;
+    /* calls callee with the count arguments at the start of frame */
+    Value call(const Value& callee, Value* frame, unsigned int count, unsigned int line);
+
+    /* reports the first construct this engine can't run */
+    void unsupported(const std::string& what, unsigned int line);
+
+    Global& global(Symbol name) {
+        if(name >= globals.size()) globals.resize(name + 1);
+        return globals[name];
+    }
+    /* throws if name was never defined */
+    Global& defined(Symbol name, unsigned int line);
+
+    /* what the last visit compiled its node to */
+    ExprCode expr;
+    StmtCode stmt;
+
+    /* for each open scope, the index of its first variable */
+    std::vector<unsigned int> scopes;
+    /*
+    ** how many slots of the frame are in use, i.e. the index the next local
+    ** or call argument goes in, and the most there have been
+    */
+    unsigned int locals = 0;
+    unsigned int frameSize = 0;
+
+    /* allocated up front and never reallocated, since frames point into it */
+    std::vector<Value> stack;
+    std::vector<Global> globals;
+    /* how many calls are under way, and what the last return gave */
+    unsigned int depth = 0;
+    Value returned;
+    bool reported = false;
+};
+
+/*
+** A function the ClosureCompiler compiled: the closures of its body, which
+** run on a frame that starts with the arguments, and how many slots that
+** frame needs.
+*/
+class CodeFunction : public Obj {
+public:
+    CodeFunction(Symbol name, unsigned int arity): name(name), arity(arity) {
+        type = ObjType::CODE;
+        refs = 0;
+    }
+    CodeFunction(const CodeFunction&) = delete;
+
+    std::string toString() const {
+        return "<fn " + SymbolTable::name(name) + ">";
+    }
+
+    Symbol name;
+    unsigned int arity;
+    /* the locals of the body's top level, which a call clears, and the whole frame */
+    unsigned int locals = 0;
+    unsigned int frame = 0;
+    std::vector<ClosureCompiler::StmtCode> body;
+};
+
+} // namespace lox
+
+#endif
@@ -0,0 +1,389 @@
+#include<algorithm>
+
+#include"compiler.h"
+#include"environment.h"
+#include"lox.h"
+
+namespace lox {
+
+void Compiler::compile(const std::vector<StmtPtr>& statements)
+{
+    for(StmtPtr stmt : statements) compile(stmt);
+    emit(OP_RETURN, 0);
+}
+
+/* the arguments of the call are already on the stack, as the first locals */
+void Compiler::compileBody(Function& stmt)
+{
+    scopes.push_back(0);
+    locals = stmt.params.size();
+    height = locals;
+    chunk.maxStack = height;
+    for(StmtPtr s : stmt.body) compile(s);
+    emit(OP_NIL, stmt.line, 1);
+    emit(OP_RETURN, stmt.line, -1);
+}
+
+void Compiler::compile(ExprPtr expr)
+{
+    expr->accept(*this);
+}
+
+void Compiler::compile(StmtPtr stmt)
+{
+    stmt->accept(*this);
+}
+
+void Compiler::emit(OpCode op, unsigned int line, int effect)
+{
+    chunk.write(op, line);
+    height += effect;
+    chunk.maxStack = std::max(chunk.maxStack, height);
+}
+
+void Compiler::emitOperand(std::uint32_t n, unsigned int line)
+{
+    chunk.writeOperand(n, line);
+}
+
+std::size_t Compiler::emitJump(OpCode op, unsigned int line)
+{
+    emit(op, line);
+    return chunk.writeJump(line);
+}
+
+void Compiler::patchJump(std::size_t at)
+{
+    chunk.patchJump(at, chunk.code.size() - (at + 4));
+}
+
+void Compiler::emitLoop(std::size_t start, unsigned int line)
+{
+    emit(OP_LOOP, line);
+    std::size_t at = chunk.writeJump(line);
+    chunk.patchJump(at, chunk.code.size() - start);
+}
+
+void Compiler::emitPops(std::uint32_t count, unsigned int line)
+{
+    if(count == 1) emit(OP_POP, line, -1);
+    else if(count > 1)
+    {
+        emit(OP_POPN, line, -static_cast<int>(count));
+        emitOperand(count, line);
+    }
+}
+
+/* the locals are only gone on the jump; the code after it still counts them */
+void Compiler::emitLoopExit(std::vector<std::size_t>& jumps, unsigned int line)
+{
+    std::uint32_t count = locals - loops.back().locals;
+    emitPops(count, line);
+    jumps.push_back(emitJump(OP_JUMP, line));
+    height += count;
+}
+
+void Compiler::unsupported(const std::string& what, unsigned int line)
+{
+    if(reported) return;
+    Lox::error(line, what + " are only supported by --engine=tree.");
+    reported = true;
+}
+
+std::uint32_t Compiler::local(unsigned int depth, unsigned int slot) const
+{
+    /* captured variables only come with closures, so code using them is never run */
+    if(depth >= BOXED) return 0;
+    return scopes[scopes.size() - 1 - depth] + slot;
+}
+
+Value Compiler::visitAssignExpr(Assign& expr)
+{
+    compile(expr.value);
+    if(expr.depth == GLOBAL)
+    {
+        emit(OP_SET_GLOBAL, expr.line);
+        emitOperand(expr.name, expr.line);
+    }
+    else
+    {
+        emit(OP_SET_LOCAL, expr.line);
+        emitOperand(local(expr.depth, expr.slot), expr.line);
+    }
+    return nullptr;
+}
+
+Value Compiler::visitBinaryExpr(Binary& expr)
+{
+    compile(expr.left);
+    /* both sides are evaluated either way, and the left one dropped */
+    if(expr.oper == COMMA)
+    {
+        emit(OP_POP, expr.line, -1);
+        compile(expr.right);
+        return nullptr;
+    }
+    compile(expr.right);
+
+    switch(expr.oper)
+    {
+    case PLUS:          emit(OP_ADD, expr.line, -1); break;
+    case MINUS:         emit(OP_SUBTRACT, expr.line, -1); break;
+    case STAR:          emit(OP_MULTIPLY, expr.line, -1); break;
+    case SLASH:         emit(OP_DIVIDE, expr.line, -1); break;
+    case GREATER:       emit(OP_GREATER, expr.line, -1); break;
+    case GREATER_EQUAL: emit(OP_GREATER_EQUAL, expr.line, -1); break;
+    case LESS:          emit(OP_LESS, expr.line, -1); break;
+    case LESS_EQUAL:    emit(OP_LESS_EQUAL, expr.line, -1); break;
+    case EQUAL_EQUAL:   emit(OP_EQUAL, expr.line, -1); break;
+    case BANG_EQUAL:
+        emit(OP_EQUAL, expr.line, -1);
+        emit(OP_NOT, expr.line);
+        break;
+    default:
+        /* the Interpreter gives nil for an operator it doesn't know */
+        emit(OP_POPN, expr.line, -2);
+        emitOperand(2, expr.line);
+        emit(OP_NIL, expr.line, 1);
+        break;
+    }
+    return nullptr;
+}
+
+/* the callee is below its arguments, and the result takes its place */
+Value Compiler::visitCallExpr(Call& expr)
+{
+    compile(expr.callee);
+    for(ExprPtr arg : expr.args) compile(arg);
+    emit(OP_CALL, expr.line, -static_cast<int>(expr.args.size()));
+    emitOperand(expr.args.size(), expr.line);
+    return nullptr;
+}
+
+Value Compiler::visitGetExpr(Get& expr)
+{
+    unsupported("Classes", expr.line);
+    emit(OP_NIL, expr.line, 1);
+    return nullptr;
+}
+
+Value Compiler::visitGroupingExpr(Grouping& expr)
+{
+    compile(expr.expr);
+    return nullptr;
+}
+
+Value Compiler::visitLiteralExpr(Literal& expr)
+{
+    const Value& value = expr.value;
+    if(value.isNil()) emit(OP_NIL, expr.line, 1);
+    else if(value.isBool()) emit(value.asBool() ? OP_TRUE : OP_FALSE, expr.line, 1);
+    else
+    {
+        emit(OP_CONSTANT, expr.line, 1);
+        emitOperand(chunk.addConstant(value), expr.line);
+    }
+    return nullptr;
+}
+
+/* the left operand is the result if it decides it, else the right one is */
+Value Compiler::visitLogicalExpr(Logical& expr)
+{
+    compile(expr.left);
+    std::size_t end = emitJump(expr.oper == OR ? OP_JUMP_IF_TRUE : OP_JUMP_IF_FALSE, expr.line);
+    emit(OP_POP, expr.line, -1);
+    compile(expr.right);
+    patchJump(end);
+    return nullptr;
+}
+
+Value Compiler::visitSetExpr(Set& expr)
+{
+    unsupported("Classes", expr.line);
+    emit(OP_NIL, expr.line, 1);
+    return nullptr;
+}
+
+Value Compiler::visitSuperExpr(Super& expr)
+{
+    emit(OP_NIL, expr.line, 1);
+    return nullptr;
+}
+
+Value Compiler::visitThisExpr(This& expr)
+{
+    unsupported("Classes", expr.line);
+    emit(OP_NIL, expr.line, 1);
+    return nullptr;
+}
+
+Value Compiler::visitUnaryExpr(Unary& expr)
+{
+    compile(expr.right);
+    switch(expr.oper)
+    {
+    case MINUS: emit(OP_NEGATE, expr.line); break;
+    case BANG:  emit(OP_NOT, expr.line); break;
+    default:
+        emit(OP_POP, expr.line, -1);
+        emit(OP_NIL, expr.line, 1);
+        break;
+    }
+    return nullptr;
+}
+
+Value Compiler::visitVariableExpr(Variable& expr)
+{
+    if(expr.depth == GLOBAL)
+    {
+        emit(OP_GET_GLOBAL, expr.line, 1);
+        emitOperand(expr.name, expr.line);
+    }
+    else if(expr.depth == CALLEE) emit(OP_GET_CALLEE, expr.line, 1);
+    else
+    {
+        emit(OP_GET_LOCAL, expr.line, 1);
+        emitOperand(local(expr.depth, expr.slot), expr.line);
+    }
+    return nullptr;
+}
+
+/*
+** The block's variables are pushed by their declarations and popped at the
+** end. The locals in scope never change at run time, so a block whose
+** function's frame would alone be past the Interpreter's FrameStack limit
+** is known here, and is replaced with the error it would raise on entry.
+** The VM checks the rest when it calls a function, see VM::run().
+*/
+void Compiler::visitBlockStmt(Block& stmt)
+{
+    if(locals + stmt.slots > FrameStack::DEFAULT_SLOTS)
+    {
+        emit(OP_OVERFLOW, stmt.line);
+        return;
+    }
+
+    scopes.push_back(locals);
+    for(StmtPtr s : stmt.statements) compile(s);
+    std::uint32_t count = locals - scopes.back();
+    scopes.pop_back();
+    locals -= count;
+    emitPops(count, stmt.line);
+}
+
+void Compiler::visitBreakStmt(Break& stmt)
+{
+    emitLoopExit(loops.back().breaks, stmt.line);
+}
+
+void Compiler::visitClassStmt(Class& stmt)
+{
+    unsupported("Classes", stmt.line);
+}
+
+void Compiler::visitContinueStmt(Continue& stmt)
+{
+    emitLoopExit(loops.back().continues, stmt.line);
+}
+
+void Compiler::visitExpressionStmt(Expression& stmt)
+{
+    compile(stmt.expression);
+    emit(OP_POP, stmt.expression->line, -1);
+}
+
+/* the function is a constant, and a declaration defines it like a var */
+void Compiler::visitFunctionStmt(Function& stmt)
+{
+    if(!stmt.captures.empty()) unsupported("Closures", stmt.line);
+
+    CompiledFunction* function = new CompiledFunction(stmt.name, stmt.params.size());
+    Value value = Value::object(function);
+    Compiler body(function->chunk);
+    body.reported = reported;
+    body.compileBody(stmt);
+    reported = body.reported;
+
+    emit(OP_CONSTANT, stmt.line, 1);
+    emitOperand(chunk.addConstant(std::move(value)), stmt.line);
+    if(scopes.empty())
+    {
+        emit(OP_DEFINE_GLOBAL, stmt.line, -1);
+        emitOperand(stmt.name, stmt.line);
+    }
+    else ++locals;
+}
+
+/* the condition is still on the stack wherever a jump on it lands */
+void Compiler::visitIfStmt(If& stmt)
+{
+    unsigned int line = stmt.condition->line;
+    compile(stmt.condition);
+    std::size_t elseJump = emitJump(OP_JUMP_IF_FALSE, line);
+    emit(OP_POP, line, -1);
+    compile(stmt.thenBranch);
+    std::size_t end = emitJump(OP_JUMP, line);
+
+    patchJump(elseJump);
+    ++height;
+    emit(OP_POP, line, -1);
+    if(stmt.elseBranch != nullptr) compile(stmt.elseBranch);
+    patchJump(end);
+}
+
+void Compiler::visitPrintStmt(Print& stmt)
+{
+    compile(stmt.expression);
+    emit(OP_PRINT, stmt.expression->line, -1);
+}
+
+/* the VM drops the whole frame, so nothing is popped first */
+void Compiler::visitReturnStmt(Return& stmt)
+{
+    if(stmt.value != nullptr) compile(stmt.value);
+    else emit(OP_NIL, stmt.line, 1);
+    emit(OP_RETURN, stmt.line, -1);
+}
+
+/* a local's initial value is left on the stack, where its slot is */
+void Compiler::visitVarStmt(Var& stmt)
+{
+    if(stmt.initializer != nullptr) compile(stmt.initializer);
+    else emit(OP_NIL, stmt.line, 1);
+
+    if(scopes.empty())
+    {
+        emit(OP_DEFINE_GLOBAL, stmt.line, -1);
+        emitOperand(stmt.name, stmt.line);
+    }
+    else ++locals;
+}
+
+void Compiler::visitWhileStmt(While& stmt)
+{
+    unsigned int line = stmt.condition->line;
+    std::size_t start = chunk.code.size();
+    compile(stmt.condition);
+    std::size_t exit = emitJump(OP_JUMP_IF_FALSE, line);
+    emit(OP_POP, line, -1);
+    loops.push_back(Loop{locals, {}, {}});
+    compile(stmt.body);
+    Loop loop = std::move(loops.back());
+    loops.pop_back();
+
+    for(std::size_t at : loop.continues) patchJump(at);
+    if(stmt.increment != nullptr)
+    {
+        compile(stmt.increment);
+        emit(OP_POP, line, -1);
+    }
+    emitLoop(start, line);
+
+    patchJump(exit);
+    ++height;
+    emit(OP_POP, line, -1);
+    /* a break lands past the condition's POP, having none to pop */
+    for(std::size_t at : loop.breaks) patchJump(at);
+}
+
+} // namespace lox
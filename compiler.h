@@ -0,0 +1,111 @@
+#ifndef LOX_COMPILER_H
+#define LOX_COMPILER_H
+
+#include<cstdint>
+#include<string>
+#include<vector>
+
+#include"chunk.h"
+#include"expr.h"
+#include"stmt.h"
+
+namespace lox {
+
+/*
+** Translates a resolved Program into a Chunk for the VM. Local variables
+** live on the VM's stack, each scope's in declaration order right after
+** those of the scopes around it, so the (depth, slot) the Resolver gave a
+** use becomes a fixed stack index here. Globals are referred to by Symbol.
+**
+** Each function is compiled into a Chunk of its own, a constant of the
+** code that declares it, with its locals numbered from the start of its
+** frame: its parameters first, then the variables of its body.
+**
+** The generated code does exactly what the Interpreter would, in the same
+** order and with the same errors on the same lines. Closures and classes
+** are left to the Interpreter: a Program with a function that uses a local
+** of the code around it, or that declares a class or uses a property, is
+** reported as an error instead of being compiled.
+*/
+class Compiler : public ExprVisitor, public StmtVisitor {
+public:
+    explicit Compiler(Chunk& chunk): chunk(chunk) {}
+    Compiler(const Compiler&) = delete;
+
+    /* appends the statements to the chunk, followed by OP_RETURN */
+    void compile(const std::vector<StmtPtr>& statements);
+
+    Value visitAssignExpr(Assign& expr) override;
+    Value visitBinaryExpr(Binary& expr) override;
+    Value visitCallExpr(Call& expr) override;
+    Value visitGetExpr(Get& expr) override;
+    Value visitGroupingExpr(Grouping& expr) override;
+    Value visitLiteralExpr(Literal& expr) override;
+    Value visitLogicalExpr(Logical& expr) override;
+    Value visitSetExpr(Set& expr) override;
+    Value visitSuperExpr(Super& expr) override;
+    Value visitThisExpr(This& expr) override;
+    Value visitUnaryExpr(Unary& expr) override;
+    Value visitVariableExpr(Variable& expr) override;
+
+    void visitBlockStmt(Block& stmt) override;
+    void visitBreakStmt(Break& stmt) override;
+    void visitClassStmt(Class& stmt) override;
+    void visitContinueStmt(Continue& stmt) override;
+    void visitExpressionStmt(Expression& stmt) override;
+    void visitFunctionStmt(Function& stmt) override;
+    void visitIfStmt(If& stmt) override;
+    void visitPrintStmt(Print& stmt) override;
+    void visitReturnStmt(Return& stmt) override;
+    void visitVarStmt(Var& stmt) override;
+    void visitWhileStmt(While& stmt) override;
+
+private:
+    void compile(ExprPtr expr);
+    void compile(StmtPtr stmt);
+    /* compiles the body of stmt into this Compiler's chunk, which is the function's */
+    void compileBody(Function& stmt);
+
+    /* effect is how many values the instruction leaves on the stack, net */
+    void emit(OpCode op, unsigned int line, int effect = 0);
+    void emitOperand(std::uint32_t n, unsigned int line);
+    /* returns where to patch the distance once the target is known */
+    std::size_t emitJump(OpCode op, unsigned int line);
+    /* makes the jump at `at` land on the next instruction */
+    void patchJump(std::size_t at);
+    void emitLoop(std::size_t start, unsigned int line);
+    /* pops count locals */
+    void emitPops(std::uint32_t count, unsigned int line);
+    /* a break or continue: pops the innermost loop's locals and jumps, to be patched */
+    void emitLoopExit(std::vector<std::size_t>& jumps, unsigned int line);
+
+    /* reports the first construct the VM can't run */
+    void unsupported(const std::string& what, unsigned int line);
+
+    /* the index in the frame of a local the Resolver gave (depth, slot) */
+    std::uint32_t local(unsigned int depth, unsigned int slot) const;
+
+    /* a loop being compiled */
+    struct Loop {
+        /* how many locals were live before it */
+        std::uint32_t locals;
+        /* the jumps to its end, and to where it goes round again */
+        std::vector<std::size_t> breaks;
+        std::vector<std::size_t> continues;
+    };
+
+    Chunk& chunk;
+    /* for each open scope, the index in the frame of its first variable */
+    std::vector<std::uint32_t> scopes;
+    /* how many locals are live, i.e. the index the next one goes in */
+    std::uint32_t locals = 0;
+    /* how many values the code emitted so far leaves on the stack */
+    std::size_t height = 0;
+    /* the loops around the code being compiled, innermost last */
+    std::vector<Loop> loops;
+    bool reported = false;
+};
+
+} // namespace lox
+
+#endif
@@ -3,5 +3,22 @@
 
 namespace lox {
 
+FrameStack::FrameStack(std::size_t capacity)
+{
+    /* untouched pages of the reservation cost nothing */
+    base = static_cast<Value*>(::operator new(capacity * sizeof(Value)));
+    top = base;
+    limit = base + capacity;
+}
 
-}// namespace lox
\ No newline at end of file
+FrameStack::~FrameStack()
+{
+    ::operator delete(base);
+}
+
+void FrameStack::overflow(unsigned int line)
+{
+    throw RuntimeError(line, "Stack overflow.");
+}
+
+}// namespace lox
@@ -1,20 +1,103 @@
 #ifndef LOX_ENVIRONMENT_H
 #define LOX_ENVIRONMENT_H
 
-#include<map>
-#include<memory>
+#include<cstddef>
+#include<new>
+#include<utility>
+#include<unordered_map>
 
 #include"token.h"
-#include"interpreter.h"
 #include"runtimeerror.h"
+#include"value.h"
 
 namespace lox {
+
+/*
+** Blocks are entered and left in strict LIFO order, so the variables of the
+** scopes being executed are kept on one contiguous stack of Values owned by
+** the Interpreter, instead of each scope allocating its own storage. The
+** memory is reserved once and slots are only constructed as they are used.
+**
+** Frames never move, so a closure that can't outlive the variables it
+** captures points straight at their slots. Those captured by one that can
+** are kept in a Cell instead, see Resolver.
+*/
+class FrameStack {
+public:
+    static constexpr std::size_t DEFAULT_SLOTS = 1 << 18;
+
+    explicit FrameStack(std::size_t capacity = DEFAULT_SLOTS);
+    FrameStack(const FrameStack&) = delete;
+    ~FrameStack();
+
+    /* reserves room for size slots; line is reported if there isn't any */
+    Value* push(std::size_t size, unsigned int line) {
+        if(static_cast<std::size_t>(limit - top) < size) overflow(line);
+        Value* frame = top;
+        top += size;
+        return frame;
+    }
+    /* the slots must already be destroyed */
+    void pop(Value* frame) {
+        top = frame;
+    }
+
+private:
+    [[noreturn]] static void overflow(unsigned int line);
+
+    Value* base;
+    Value* top;
+    Value* limit;
+};
+
+/*
+** The variables of one execution of a local scope, in a frame on the
+** FrameStack which it gives back when it goes out of scope. The Resolver has
+** already numbered each scope's variables in declaration order and worked
+** out how many scopes out every use of a local is, so they are reached by
+** (depth, slot) rather than looked up by name.
+*/
 class Environment {
 public:
-    /* bind a new name to a value */
-    Environment() = default;
-    Environment(Environment* enclosing): enclosing(enclosing) {}
-    void define(const std::string& name, const Object& value) {
+    Environment(Environment* enclosing, FrameStack& frames, std::size_t size, unsigned int line):
+        slots(frames.push(size, line)), enclosing(enclosing), frames(frames) {}
+    Environment(const Environment&) = delete;
+    ~Environment() {
+        for(unsigned int i = 0; i < count; ++i) slots[i].~Value();
+        frames.pop(slots);
+    }
+
+    /*
+    ** Makes room for size more slots after this frame's. Only the frame on
+    ** top of the FrameStack can grow; a call uses this to turn the frame
+    ** its arguments were evaluated into into the function's own.
+    */
+    void grow(std::size_t size, unsigned int line) {
+        frames.push(size, line);
+    }
+
+    /* declarations run in the order the Resolver numbered them */
+    void define(Value value) {
+        new(&slots[count++]) Value(std::move(value));
+    }
+
+    Value& at(unsigned int depth, unsigned int slot) {
+        Environment* environment = this;
+        while(depth-- > 0) environment = environment->enclosing;
+        return environment->slots[slot];
+    }
+
+private:
+    Value* slots;
+    unsigned int count = 0;
+    Environment* enclosing;
+    FrameStack& frames;
+};
+
+/* names the Resolver didn't find in any local scope, looked up when used */
+class Globals {
+public:
+    void define(Symbol name, Value value) {
         /*
         ** By not checking if the name already exists, we permit
         ** variable redefinition. E.g. this is allowed:
@@ -25,37 +108,31 @@ public:
         ** is consistent with script execution
          */
 
-        values[name] = value;
+        values.insert_or_assign(name, std::move(value));
     }
 
-    Object get(const Token& name) {
-        if(!(values.find(name.lexeme) == values.end())) return values[name.lexeme];
-
-        /*try enclosing scope if variable is not found*/
-        if(enclosing != nullptr) {
-            return enclosing->get(name);
-        }
+    /* line is only used to report an undefined name */
+    const Value& get(Symbol name, unsigned int line) {
+        auto it = values.find(name);
+        if(it != values.end()) return it->second;
 
-        throw RuntimeError(name, "Undefined Identifier '" + name.lexeme + "' .");
+        throw RuntimeError(line, "Undefined Identifier '" + SymbolTable::name(name) + "' .");
     }
 
-    void assign(const Token& name, const Object& value) {
-        if(!(values.find(name.lexeme) == values.end())) {
-            values[name.lexeme] = value;
-            return;
-        }
-        /*try enclosing scope if variable is not found*/
-        if(enclosing != nullptr) {
-            enclosing->define(name.lexeme, value);
+    /* one probe each way: find, then write through the iterator */
+    void assign(Symbol name, const Value& value, unsigned int line) {
+        auto it = values.find(name);
+        if(it != values.end()) {
+            it->second = value;
             return;
         }
 
-        throw RuntimeError(name, "Undefined Identifier '" + name.lexeme + "' .");
+        throw RuntimeError(line, "Undefined Identifier '" + SymbolTable::name(name) + "' .");
     }
 private:
-    std::map<std::string, Object> values;
-    Environment *enclosing;
+    /* keyed by the interned name, see symbol.h */
+    std::unordered_map<Symbol, Value> values;
 
 };
 } // namespace lox
-#endif
\ No newline at end of file
+#endif
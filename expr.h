@@ -2,11 +2,11 @@
 #define LOX_EXPR_H
 
 #include<iostream>
-#include<memory>
 #include<vector>
-#include<variant>
 
+#include"arena.h"
 #include"token.h"
+#include"value.h"
 
 /*
  ** This file is organized into 4 parts. We begin with a definition of
@@ -21,30 +21,47 @@ namespace lox
 
 
 class ExprVisitor;
+class LoxFunction;
+class Shape;
 
 
 
+/*
+** AST nodes are allocated in the Arena of the Program being parsed and are
+** never deleted one at a time, so child links are plain pointers and the
+** destructor is neither virtual nor public.
+**
+** Nodes are kept small: each holds its own operands and nothing else, plus
+** the source line it came from for error reports. Operators are kept as a
+** TokenType and names as their interned Symbol, rather than as whole Tokens.
+*/
 class Expr {
 public:
-    Token oper;
-    std::unique_ptr<Expr> left;
-    std::unique_ptr<Expr> right;
+    unsigned int line;
     /*
     ** Because the accept() method's return type depends on the expression,
-    ** we use an std::variant. My initial plan was to use templates, but runtime polymorphism and
+    ** we return a Value, which can hold any of them. My initial plan was to use templates, but runtime polymorphism and
     ** static polymorphism don't work well simultaneously
     **
     */
-    virtual Object accept(ExprVisitor& visitor) = 0;
-    virtual ~Expr() = default; /* must implement pure virtual dtor*/
+    virtual Value accept(ExprVisitor& visitor) = 0;
+protected:
+    Expr(unsigned int line = 0): line(line) {}
+    ~Expr() = default;
 
 
 };
 
-/* pure virtual destructor definition*/
-// Expr::~Expr() = default;
+typedef Expr* ExprPtr;
 
-typedef std::unique_ptr<Expr> ExprPtr;
+/* the depth the Resolver gives a variable that is looked up by name instead */
+constexpr unsigned int GLOBAL = ~0u;
+/* the depth of a variable of an enclosing function; slot is then which of the closure's captures it is */
+constexpr unsigned int UPVALUE = GLOBAL - 1;
+/* the depth of a function's use of its own name, which is the function running, see Resolver */
+constexpr unsigned int CALLEE = UPVALUE - 1;
+/* added to the depth of a local that lives in a Cell, see Resolver */
+constexpr unsigned int BOXED = 1u << 31;
 /*foward declarations*/
 class Assign;
 class Binary;
@@ -63,72 +80,143 @@ class Expr;
 class ExprVisitor {
 public:
     ExprVisitor() = default;
-    virtual Object visitAssignExpr(Assign& expr) = 0;
-    virtual Object visitBinaryExpr(Binary& expr) = 0;
-    virtual Object visitCallExpr(Call& expr) = 0;
-    virtual Object visitGetExpr(Get& expr) = 0;
-    virtual Object visitGroupingExpr(Grouping& expr) = 0;
-    virtual Object visitLiteralExpr(Literal& expr) = 0;
-    virtual Object visitLogicalExpr(Logical& expr) = 0;
-    virtual Object visitSetExpr(Set& expr) = 0;
-    virtual Object visitSuperExpr(Super& expr) = 0;
-    virtual Object visitThisExpr(This& expr) = 0;
-    virtual Object visitUnaryExpr(Unary& expr) = 0;
-    virtual Object visitVariableExpr(Variable& expr) = 0;
+    virtual Value visitAssignExpr(Assign& expr) = 0;
+    virtual Value visitBinaryExpr(Binary& expr) = 0;
+    virtual Value visitCallExpr(Call& expr) = 0;
+    virtual Value visitGetExpr(Get& expr) = 0;
+    virtual Value visitGroupingExpr(Grouping& expr) = 0;
+    virtual Value visitLiteralExpr(Literal& expr) = 0;
+    virtual Value visitLogicalExpr(Logical& expr) = 0;
+    virtual Value visitSetExpr(Set& expr) = 0;
+    virtual Value visitSuperExpr(Super& expr) = 0;
+    virtual Value visitThisExpr(This& expr) = 0;
+    virtual Value visitUnaryExpr(Unary& expr) = 0;
+    virtual Value visitVariableExpr(Variable& expr) = 0;
     virtual ~ExprVisitor() = default;
 };
 
 /*Expr classes defintion*/
-/* These classes are non copyable because they derive from a base class with
-** non copyable std::unique_ptr's
-*/
 
 class Assign : public Expr {
 public:
-    /*We expect an "l-value" here, so the left side of our AST is a Token*/
-    Token name;
+    /*We expect an "l-value" here, so the left side of our AST is a name*/
+    Symbol name;
+    /* set by the Resolver, see Environment */
+    unsigned int depth = GLOBAL;
+    unsigned int slot = 0;
     ExprPtr value;
-    Assign(const Token& name, ExprPtr value): name(name), value(std::move(value)) {}
+    Assign(Symbol name, ExprPtr value, unsigned int line): Expr(line), name(name), value(value) {}
 
-    Object accept(ExprVisitor& visitor) {
+    Value accept(ExprVisitor& visitor) {
         return visitor.visitAssignExpr(*this);
     }
 };
+/*
+** What the Interpreter has specialized a Binary node into. A node starts
+** UNSEEN; the first time it runs, the operand types it gets pick the form
+** for its operator that skips straight to the operation after one guard on
+** them, if there is one, e.g. NUMBER_ADD for a + on two numbers. When a
+** guard fails, the node goes back to GENERIC for good.
+*/
+enum class BinaryForm : unsigned char {
+    UNSEEN,
+    GENERIC,
+    NUMBER_ADD,
+    NUMBER_SUBTRACT,
+    NUMBER_MULTIPLY,
+    NUMBER_DIVIDE,
+    NUMBER_GREATER,
+    NUMBER_GREATER_EQUAL,
+    NUMBER_LESS,
+    NUMBER_LESS_EQUAL,
+    STRING_CONCAT
+};
+
 class Binary : public Expr {
 public:
+    TokenType oper;
+    /* rewritten as the node runs, see Interpreter::visitBinaryExpr */
+    BinaryForm form = BinaryForm::UNSEEN;
+    ExprPtr left;
+    ExprPtr right;
     Binary(ExprPtr left, const Token& oper, ExprPtr right)
-    {
-        this->left = std::move(left);
-        this->right = std::move(right);
-        this->oper = oper;
-    }
-    Object accept(ExprVisitor& visitor) override {
+        : Expr(oper.line), oper(oper.type), left(left), right(right) {}
+
+    Value accept(ExprVisitor& visitor) override {
         return visitor.visitBinaryExpr(*this);
     }
 };
 
 class Call : public Expr {
 public:
-    Token paren;
-    std::vector<ExprPtr> args;
     ExprPtr callee;
-    Call(const Token& paren, ExprPtr callee, std::vector<ExprPtr> args)
-        : paren(paren), args(std::move(args)), callee(std::move(callee)) {}
+    ArenaList<ExprPtr> args;
+    /*
+    ** Whether the callee is a Get or Super, whose method is then called
+    ** with its receiver rather than bound to it first; set by the Resolver.
+    */
+    bool invoke = false;
+    /* line is that of the closing parenthesis */
+    Call(const Token& paren, ExprPtr callee, ArenaList<ExprPtr> args)
+        : Expr(paren.line), callee(callee), args(args) {}
 
-    Object accept(ExprVisitor& visitor) override {
+    Value accept(ExprVisitor& visitor) override {
         return visitor.visitCallExpr(*this);
     }
 };
 
 
+/*
+** An inline cache on a Get or Set, filled in by the Interpreter as the node
+** runs: for each of the last few Shapes of instance it has seen there, the
+** slot the field is in, or for a Get the method the name is instead. Entries
+** are keyed by Shape::id rather than by the Shape, so one for a Shape that
+** is gone never matches again. A Shape belongs to one class, whose methods
+** never change, so an entry never needs to be invalidated. Once all are
+** used the node is megamorphic, and a Shape not among them is looked up
+** every time.
+*/
+struct PropertyCache {
+    static constexpr unsigned int SIZE = 4;
+
+    struct Entry {
+        unsigned int shape;
+        /* Shape::NONE for a method */
+        unsigned int slot;
+        union {
+            /* for a Set that adds the field, the Shape the instance is given */
+            Shape* transition;
+            /* for a Get of a method, the method, which its class keeps alive */
+            LoxFunction* method;
+        };
+    };
+
+    /* the entry for the Shape with id shape, or nullptr */
+    const Entry* find(unsigned int shape) const {
+        for(unsigned int i = 0; i < count; ++i)
+        {
+            if(entries[i].shape == shape) return &entries[i];
+        }
+        return nullptr;
+    }
+    void add(const Entry& entry) {
+        if(count < SIZE) entries[count++] = entry;
+    }
+
+    Entry entries[SIZE];
+    unsigned int count = 0;
+};
+
 class Get : public Expr {
 public:
+    Symbol name;
     ExprPtr object;
-    Token name;
+    /* see Interpreter::visitGetExpr */
+    PropertyCache cache;
     Get(ExprPtr object, const Token& name)
-        : object(std::move(object)), name(name) {}
+        : Expr(name.line), name(name.symbol), object(object) {}
 
-    Object accept(ExprVisitor& visitor) override {
+    Value accept(ExprVisitor& visitor) override {
         return visitor.visitGetExpr(*this);
     }
 };
@@ -136,46 +224,50 @@ public:
 class Grouping : public Expr {
 public:
     ExprPtr expr;
-    Grouping(ExprPtr expr):expr(std::move(expr)) {}
+    Grouping(ExprPtr expr): Expr(expr->line), expr(expr) {}
 
-    Object accept(ExprVisitor& visitor) override {
+    Value accept(ExprVisitor& visitor) override {
         return visitor.visitGroupingExpr(*this);
     }
 };
 
+/* the one node with a destructor to run, when it holds a string */
 class Literal : public Expr {
 public:
-    Object value;
-    Literal(const Object& value): value(value) {}
+    Value value;
+    Literal(const Value& value): value(value) {}
 
-    Object accept(ExprVisitor& visitor) override {
+    Value accept(ExprVisitor& visitor) override {
         return visitor.visitLiteralExpr(*this);
     }
 };
 
 class Logical : public Expr {
 public:
+    TokenType oper;
+    ExprPtr left;
+    ExprPtr right;
     Logical(ExprPtr left, const Token& oper, ExprPtr right)
-    {
-        this->left = std::move(left);
-        this->right = std::move(right);
-        this->oper = oper;
-    }
-    Object accept(ExprVisitor& visitor) override {
+        : Expr(oper.line), oper(oper.type), left(left), right(right) {}
+
+    Value accept(ExprVisitor& visitor) override {
         return visitor.visitLogicalExpr(*this);
     }
 };
 
 class Set : public Expr {
 public:
+    Symbol name;
     ExprPtr object;
-    Token name;
     ExprPtr value;
+    /* see Interpreter::visitSetExpr */
+    PropertyCache cache;
 
-    Set(ExprPtr object, const Token& name, ExprPtr value)
-        : object(std::move(object)), name(name), value(std::move(value)) {}
+    /* like Assign, made from the Get the parser took for the target */
+    Set(ExprPtr object, Symbol name, ExprPtr value, unsigned int line)
+        : Expr(line), name(name), object(object), value(value) {}
 
-    Object accept(ExprVisitor& visitor) override {
+    Value accept(ExprVisitor& visitor) override {
         return visitor.visitSetExpr(*this);
     }
 
@@ -183,11 +275,28 @@ public:
 
 class Super : public Expr {
 public:
-    Token keyword;
-    Token method;
-    Super(const Token& keyword, const Token& method): keyword(keyword), method(method) {}
-
-    Object accept(ExprVisitor& visitor) override {
+    Symbol method;
+    /*
+    ** Set by the Resolver: where the superclass is, a local of the scope the
+    ** methods are declared in, and where this is.
+    */
+    unsigned int depth = GLOBAL;
+    unsigned int slot = 0;
+    unsigned int thisDepth = GLOBAL;
+    unsigned int thisSlot = 0;
+    /*
+    ** The method last found, and the id of the superclass it was found in,
+    ** see Interpreter::visitSuperExpr. The same node runs with a different
+    ** superclass only if its class declaration runs again.
+    */
+    struct {
+        unsigned int klass = 0;
+        LoxFunction* method = nullptr;
+    } cache;
+    /* line is that of the 'super' keyword */
+    Super(const Token& keyword, const Token& method): Expr(keyword.line), method(method.symbol) {}
+
+    Value accept(ExprVisitor& visitor) override {
         return visitor.visitSuperExpr(*this);
     }
 
@@ -195,10 +304,12 @@ public:
 
 class This : public Expr {
 public:
-    Token keyword;
-    This(const Token& keyword): keyword(keyword) {}
+    /* set by the Resolver, which makes this a local of every method */
+    unsigned int depth = GLOBAL;
+    unsigned int slot = 0;
+    This(const Token& keyword): Expr(keyword.line) {}
 
-    Object accept(ExprVisitor& visitor) override {
+    Value accept(ExprVisitor& visitor) override {
         return visitor.visitThisExpr(*this);
     }
 
@@ -206,12 +317,11 @@ public:
 
 class Unary : public Expr {
 public:
-    Unary(const Token& oper, ExprPtr right)
-    {
-        this->oper = oper;
-        this->right = std::move(right);
-    }
-    Object accept(ExprVisitor& visitor) override {
+    TokenType oper;
+    ExprPtr right;
+    Unary(const Token& oper, ExprPtr right): Expr(oper.line), oper(oper.type), right(right) {}
+
+    Value accept(ExprVisitor& visitor) override {
         return visitor.visitUnaryExpr(*this);
     }
 
@@ -220,10 +330,13 @@ public:
 class Variable : public Expr {
 public:
 
-    Token name;
-    Variable(const Token& name): name(name) {}
+    Symbol name;
+    /* set by the Resolver, see Environment */
+    unsigned int depth = GLOBAL;
+    unsigned int slot = 0;
+    Variable(const Token& name): Expr(name.line), name(name.symbol) {}
 
-    Object accept(ExprVisitor& visitor) override {
+    Value accept(ExprVisitor& visitor) override {
         return visitor.visitVariableExpr(*this);
     }
 
@@ -231,9 +344,37 @@ public:
 };
 
 
+/* only Literal should need its destructor run by the Arena */
+static_assert(std::is_trivially_destructible<Binary>::value, "Expr nodes must not own anything");
+static_assert(std::is_trivially_destructible<Call>::value, "Expr nodes must not own anything");
+static_assert(std::is_trivially_destructible<Variable>::value, "Expr nodes must not own anything");
+static_assert(std::is_trivially_destructible<Set>::value, "Expr nodes must not own anything");
+static_assert(std::is_trivially_destructible<Super>::value, "Expr nodes must not own anything");
+
 /* class to print our ast*/
 class AstNodePrinter : public ExprVisitor {
 public:
+    /* nodes only keep the operator's type, so we spell it out again */
+    static std::string spelling(TokenType oper) {
+        switch(oper)
+        {
+        case MINUS: return "-";
+        case PLUS: return "+";
+        case SLASH: return "/";
+        case STAR: return "*";
+        case BANG: return "!";
+        case COMMA: return ",";
+        case BANG_EQUAL: return "!=";
+        case EQUAL_EQUAL: return "==";
+        case GREATER: return ">";
+        case GREATER_EQUAL: return ">=";
+        case LESS: return "<";
+        case LESS_EQUAL: return "<=";
+        case AND: return "and";
+        case OR: return "or";
+        default: return "?";
+        }
+    }
     std::string parenthesize(const std::string& name, std::vector<Expr*>& exprs) {
 
         std::string AstString("(" + name);
@@ -243,10 +384,10 @@ public:
             AstString += " ";
             auto val = expr->accept(*this);
 
-            if(std::holds_alternative<std::string>(val))
-                AstString += std::get<std::string>(val);
-            else if(std::holds_alternative<double>(val))
-                AstString += std::to_string(std::get<double>(val));
+            if(val.isString())
+                AstString += val.asString();
+            else if(val.isNumber())
+                AstString += std::to_string(val.asNumber());
             else
                 AstString += " ";
 
@@ -261,63 +402,59 @@ public:
     std::string print(Expr* expr) {
 
         auto val = expr->accept(*this);
-        return std::holds_alternative<std::string>(val) ?
-               std::get<std::string>(val) : std::string(" ");
+        return val.isString() ? val.asString() : std::string(" ");
 
     }
     /* place holder std::string("") returns for some of these. Might implement lateron*/
-    virtual Object visitAssignExpr(Assign& expr) override {
-        return std::string("");
+    virtual Value visitAssignExpr(Assign& expr) override {
+        return Value::string("");
     }
-    virtual Object visitBinaryExpr(Binary& expr)override {
-        std::vector<Expr*> v = {expr.left.get(), expr.right.get()};
-        return parenthesize(expr.oper.lexeme, v);
+    virtual Value visitBinaryExpr(Binary& expr)override {
+        std::vector<Expr*> v = {expr.left, expr.right};
+        return Value::string(parenthesize(spelling(expr.oper), v));
     }
-    virtual Object visitCallExpr(Call& expr)override {
-        return std::string("");
+    virtual Value visitCallExpr(Call& expr)override {
+        return Value::string("");
     }
-    virtual Object visitGetExpr(Get& expr)override {
-        return std::string("");
+    virtual Value visitGetExpr(Get& expr)override {
+        return Value::string("");
     }
-    virtual Object visitGroupingExpr(Grouping& expr)override {
-        std::vector<Expr*> v = {expr.expr.get()};
-        return parenthesize("group", v);
+    virtual Value visitGroupingExpr(Grouping& expr)override {
+        std::vector<Expr*> v = {expr.expr};
+        return Value::string(parenthesize("group", v));
     }
-    virtual Object visitLiteralExpr(Literal& expr)override {
-
-        if(std::holds_alternative<std::string>(expr.value))
-        {
-            if(std::get<std::string>(expr.value) == "__null__" )
-                return std::string("nil");
-            return std::get<std::string>(expr.value);
-        }
-
-        else if(std::holds_alternative<double>(expr.value))
-            return std::to_string(std::get<double>(expr.value));
+    virtual Value visitLiteralExpr(Literal& expr)override {
+
+        if(expr.value.isString())
+            return expr.value;
+        else if(expr.value.isNil())
+            return Value::string("nil");
+        else if(expr.value.isNumber())
+            return Value::string(std::to_string(expr.value.asNumber()));
         else
-            return std::string(" ");
+            return Value::string(" ");
 
     }
 
-    virtual Object visitLogicalExpr(Logical& expr)override {
-        std::vector<Expr*> v = {expr.left.get(), expr.right.get()};
-        return parenthesize(expr.oper.lexeme, v);
+    virtual Value visitLogicalExpr(Logical& expr)override {
+        std::vector<Expr*> v = {expr.left, expr.right};
+        return Value::string(parenthesize(spelling(expr.oper), v));
     }
-    virtual Object visitSetExpr(Set& expr)override {
-        return std::string("");
+    virtual Value visitSetExpr(Set& expr)override {
+        return Value::string("");
     }
-    virtual Object visitSuperExpr(Super& expr)override {
-        return std::string("");
+    virtual Value visitSuperExpr(Super& expr)override {
+        return Value::string("");
     }
-    virtual Object visitThisExpr(This& expr)override {
-        return std::string("");
+    virtual Value visitThisExpr(This& expr)override {
+        return Value::string("");
     }
-    virtual Object visitUnaryExpr(Unary& expr)override {
-        std::vector<Expr*> v = {expr.right.get()};
-        return parenthesize(expr.oper.lexeme, v);
+    virtual Value visitUnaryExpr(Unary& expr)override {
+        std::vector<Expr*> v = {expr.right};
+        return Value::string(parenthesize(spelling(expr.oper), v));
     }
-    virtual Object visitVariableExpr(Variable& expr)override {
-        return std::string("");
+    virtual Value visitVariableExpr(Variable& expr)override {
+        return Value::string("");
     }
 };
 
@@ -0,0 +1,54 @@
+#include"instance.h"
+#include"interpreter.h"
+#include"stmt.h"
+
+namespace lox {
+
+unsigned int LoxClass::arity() const
+{
+    return initializer != nullptr ? initializer->arity() : 0;
+}
+
+Value LoxClass::call(Interpreter& interpreter, Environment& frame, unsigned int line)
+{
+    Value instance = Value::object(new LoxInstance(*this));
+    if(initializer != nullptr) interpreter.callFunction(*initializer, frame, line, &instance);
+    return instance;
+}
+
+std::string LoxClass::toString() const
+{
+    return SymbolTable::name(name);
+}
+
+LoxFunction* LoxClass::findMethod(Symbol name) const
+{
+    auto it = methods.find(name);
+    if(it == methods.end()) return nullptr;
+    return static_cast<LoxFunction*>(it->second.asObj());
+}
+
+LoxInstance::LoxInstance(LoxClass& klass):
+    klass(klass), shape(&klass.shape), reference(Value::object(&klass))
+{
+    type = ObjType::INSTANCE;
+    refs = 0;
+    fields.reserve(klass.fields);
+}
+
+unsigned int BoundMethod::arity() const
+{
+    return function().arity();
+}
+
+Value BoundMethod::call(Interpreter& interpreter, Environment& frame, unsigned int line)
+{
+    return interpreter.callFunction(function(), frame, line, &receiver);
+}
+
+std::string BoundMethod::toString() const
+{
+    return function().toString();
+}
+
+} // namespace lox
@@ -0,0 +1,92 @@
+#ifndef LOX_INSTANCE_H
+#define LOX_INSTANCE_H
+
+#include<string>
+#include<unordered_map>
+#include<vector>
+
+#include"callable.h"
+#include"shape.h"
+#include"symbol.h"
+#include"value.h"
+
+namespace lox {
+
+/*
+** A class, made when its declaration runs, and called to make an instance.
+** Calling it runs its init method, if it has one, on the new instance with
+** the call's arguments.
+**
+** Its methods are flattened: the table starts as a copy of the superclass's,
+** which its own methods are then added to or replace, so finding an
+** inherited method takes one lookup however deep the hierarchy. The table
+** is never changed after the declaration has run. Declaring the superclass
+** again, e.g. at the REPL, makes a new class and leaves this one as it was.
+*/
+class LoxClass : public LoxCallable {
+public:
+    explicit LoxClass(Symbol name): LoxCallable(ObjType::CLASS), name(name) {}
+
+    unsigned int arity() const override;
+    Value call(Interpreter& interpreter, Environment& frame, unsigned int line) override;
+    std::string toString() const override;
+
+    /* the method called name, or nullptr */
+    LoxFunction* findMethod(Symbol name) const;
+
+    /* tells this class apart from every other there has been, as Shape::id does */
+    unsigned int id() const {
+        return shape.id;
+    }
+
+    Symbol name;
+    /* each holds a LoxFunction, inherited ones included */
+    std::unordered_map<Symbol, Value> methods;
+    /* its init method, or nullptr */
+    LoxFunction* initializer = nullptr;
+    /* the Shape its instances start out with, the root of their tree */
+    Shape shape;
+    /* the most fields an instance of it has had, which new ones make room for */
+    unsigned int fields = 0;
+};
+
+/*
+** An instance's fields are kept by slot, in the order they were first
+** assigned, and shape says which is which, see Shape.
+*/
+class LoxInstance : public Obj {
+public:
+    explicit LoxInstance(LoxClass& klass);
+    LoxInstance(const LoxInstance&) = delete;
+
+    LoxClass& klass;
+    Shape* shape;
+    std::vector<Value> fields;
+
+private:
+    /* keeps klass, and so its Shapes, alive */
+    Value reference;
+};
+
+/* a method got from an instance, which runs with that instance as this */
+class BoundMethod : public LoxCallable {
+public:
+    BoundMethod(Value receiver, Value method):
+        LoxCallable(ObjType::BOUND_METHOD), receiver(std::move(receiver)), method(std::move(method)) {}
+
+    unsigned int arity() const override;
+    Value call(Interpreter& interpreter, Environment& frame, unsigned int line) override;
+    std::string toString() const override;
+
+private:
+    LoxFunction& function() const {
+        return *static_cast<LoxFunction*>(method.asObj());
+    }
+
+    Value receiver;
+    Value method;
+};
+
+} // namespace lox
+
+#endif
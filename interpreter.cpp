@@ -1,3 +1,6 @@
+#include"callable.h"
+#include"chunk.h"
+#include"closurecompiler.h"
 #include"interpreter.h"
 #include"environment.h"
 #include"lox.h"
@@ -6,92 +9,172 @@
 
 namespace lox {
 
-Interpreter::Interpreter():environment(new Environment()) {}
+namespace {
+
+/* points current at scope for as long as it lives, however that ends */
+class EnterScope {
+public:
+    EnterScope(Environment*& current, Environment& scope): current(current), previous(current) {
+        current = &scope;
+    }
+    EnterScope(const EnterScope&) = delete;
+    ~EnterScope() {
+        current = previous;
+    }
+private:
+    Environment*& current;
+    Environment* previous;
+};
+
+} // namespace
+
+Interpreter::Interpreter():globals(new Globals()), initName(SymbolTable::intern("init")) {
+    globals->define(SymbolTable::intern("clock"), Value::object(new NativeFunction(0, clockNative)));
+}
 
 
 Interpreter::~Interpreter() {
 
 }
-Object Interpreter::evaluate(ExprPtr& expr) {
+Value Interpreter::evaluate(ExprPtr expr) {
     return expr->accept(*this);
 }
 
-bool  Interpreter::isTruthy(const Object& obj) {
-    /*everything else but false and nil is truthy in Lox*/
-    if(std::holds_alternative<void*>(obj))
-        return false;
-    if(std::holds_alternative<bool>(obj))
-        return std::get<bool>(obj);
-    return true;
+bool  Interpreter::isTruthy(const Value& obj) {
+    return obj.isTruthy();
 }
 
-bool Interpreter::isEqual(const Object& a, const Object& b) {
-    /* nil is only equal to nil*/
-    if(std::holds_alternative<void*>(a)
-            && std::holds_alternative<void*>(b))
-        return true;
-    if(std::holds_alternative<void*>(a)) return false;
-
+bool Interpreter::isEqual(const Value& a, const Value& b) {
+    /* nil is only equal to nil, see Value::operator== */
     return a == b;
 }
 
-void Interpreter::checkNumberOperand(const Token& oper, const Object& operand) {
-    if(std::holds_alternative<double>(operand)) return;
-    throw RuntimeError(oper, "Operand must be a number.");
+void Interpreter::checkNumberOperand(unsigned int line, const Value& operand) {
+    if(operand.isNumber()) return;
+    throw RuntimeError(line, "Operand must be a number.");
 }
 
-void Interpreter::checkNumberOperands(const Token& oper, const Object& left, const Object& right) {
-    if(std::holds_alternative<double>(left)
-            && std::holds_alternative<double>(right)) return;
+void Interpreter::checkNumberOperands(unsigned int line, const Value& left, const Value& right) {
+    if(left.isNumber() && right.isNumber()) return;
 
-    throw RuntimeError(oper, "Operand must be a number.");
+    throw RuntimeError(line, "Operand must be a number.");
 }
 
-Object Interpreter::visitAssignExpr(Assign& expr) {
-    Object value = evaluate(expr.value);
+Value Interpreter::visitAssignExpr(Assign& expr) {
+    Value value = evaluate(expr.value);
 
-    environment->assign(expr.name, value);
+    if(expr.depth == GLOBAL) globals->assign(expr.name, value, expr.line);
+    else local(expr.depth, expr.slot) = value;
     return value;
 }
-Object Interpreter::visitBinaryExpr(Binary& expr) {
-    Object left = evaluate(expr.left);
-    Object right = evaluate(expr.right);
+/* the form for oper that suits left and right, see BinaryForm */
+BinaryForm Interpreter::specialize(TokenType oper, const Value& left, const Value& right) {
+    if(left.isNumber() && right.isNumber()) {
+        switch(oper) {
+        case PLUS: return BinaryForm::NUMBER_ADD;
+        case MINUS: return BinaryForm::NUMBER_SUBTRACT;
+        case STAR: return BinaryForm::NUMBER_MULTIPLY;
+        case SLASH: return BinaryForm::NUMBER_DIVIDE;
+        case GREATER: return BinaryForm::NUMBER_GREATER;
+        case GREATER_EQUAL: return BinaryForm::NUMBER_GREATER_EQUAL;
+        case LESS: return BinaryForm::NUMBER_LESS;
+        case LESS_EQUAL: return BinaryForm::NUMBER_LESS_EQUAL;
+        default: break;
+        }
+    }
+    if(oper == PLUS && left.isString() && right.isString()) return BinaryForm::STRING_CONCAT;
+    return BinaryForm::GENERIC;
+}
+
+void Interpreter::rewrite(Binary& expr, BinaryForm form) {
+    expr.form = form;
+    if(!recording) return;
 
-    switch(expr.oper.type) {
+    auto [it, added] = rewritten.try_emplace(&expr, rewrites.size());
+    if(added) rewrites.push_back({expr.line, expr.oper, form, form});
+    else rewrites[it->second].form = form;
+}
+
+/*
+** A specialized node checks the operand types it was specialized for and
+** goes straight to the operation, without looking at the operator. Failing
+** that, and for every other node, the operator decides below.
+*/
+Value Interpreter::visitBinaryExpr(Binary& expr) {
+    Value left = evaluate(expr.left);
+    Value right = evaluate(expr.right);
+
+    BinaryForm form = expr.form;
+    switch(form) {
+    case BinaryForm::NUMBER_ADD:
+        if(left.isNumber() && right.isNumber()) return left.asNumber() + right.asNumber();
+        break;
+    case BinaryForm::NUMBER_SUBTRACT:
+        if(left.isNumber() && right.isNumber()) return left.asNumber() - right.asNumber();
+        break;
+    case BinaryForm::NUMBER_MULTIPLY:
+        if(left.isNumber() && right.isNumber()) return left.asNumber() * right.asNumber();
+        break;
+    case BinaryForm::NUMBER_DIVIDE:
+        if(left.isNumber() && right.isNumber()) return left.asNumber() / right.asNumber();
+        break;
+    case BinaryForm::NUMBER_GREATER:
+        if(left.isNumber() && right.isNumber()) return left.asNumber() > right.asNumber();
+        break;
+    case BinaryForm::NUMBER_GREATER_EQUAL:
+        if(left.isNumber() && right.isNumber()) return left.asNumber() >= right.asNumber();
+        break;
+    case BinaryForm::NUMBER_LESS:
+        if(left.isNumber() && right.isNumber()) return left.asNumber() < right.asNumber();
+        break;
+    case BinaryForm::NUMBER_LESS_EQUAL:
+        if(left.isNumber() && right.isNumber()) return left.asNumber() <= right.asNumber();
+        break;
+    case BinaryForm::STRING_CONCAT:
+        if(left.isString() && right.isString()) return Value::concatenate(std::move(left), right);
+        break;
+    case BinaryForm::UNSEEN:
+        rewrite(expr, specialize(expr.oper, left, right));
+        break;
+    case BinaryForm::GENERIC:
+        break;
+    }
+    /* a guard failed */
+    if(form != BinaryForm::UNSEEN && form != BinaryForm::GENERIC) rewrite(expr, BinaryForm::GENERIC);
+
+    switch(expr.oper) {
     case PLUS:
-        if(std::holds_alternative<double>(right)
-                && std::holds_alternative<double>(left)) {
+        if(right.isNumber() && left.isNumber()) {
 
-            return std::get<double>(left) + std::get<double>(right);
+            return left.asNumber() + right.asNumber();
         }
 
-        if(std::holds_alternative<std::string>(right)
-                && std::holds_alternative<std::string>(left)) {
-            return std::get<std::string>(left) + std::get<std::string>(right);
+        if(right.isString() && left.isString()) {
+            return Value::concatenate(std::move(left), right);
         }
-        throw RuntimeError(expr.oper,"Operands must be two numbers or two strings.");
+        throw RuntimeError(expr.line,"Operands must be two numbers or two strings.");
 
     case MINUS:
-        checkNumberOperands(expr.oper, left, right);
-        return std::get<double>(left) - std::get<double>(right);
+        checkNumberOperands(expr.line, left, right);
+        return left.asNumber() - right.asNumber();
     case SLASH:
-        checkNumberOperands(expr.oper, left, right);
-        return std::get<double>(left) / std::get<double>(right);
+        checkNumberOperands(expr.line, left, right);
+        return left.asNumber() / right.asNumber();
     case STAR:
-        checkNumberOperands(expr.oper, left, right);
-        return std::get<double>(left) * std::get<double>(right);
+        checkNumberOperands(expr.line, left, right);
+        return left.asNumber() * right.asNumber();
     case GREATER:
-        checkNumberOperands(expr.oper, left, right);
-        return std::get<double>(left) > std::get<double>(right);
+        checkNumberOperands(expr.line, left, right);
+        return left.asNumber() > right.asNumber();
     case GREATER_EQUAL:
-        checkNumberOperands(expr.oper, left, right);
-        return std::get<double>(left) >= std::get<double>(right);
+        checkNumberOperands(expr.line, left, right);
+        return left.asNumber() >= right.asNumber();
     case LESS:
-        checkNumberOperands(expr.oper, left, right);
-        return std::get<double>(left) < std::get<double>(right);
+        checkNumberOperands(expr.line, left, right);
+        return left.asNumber() < right.asNumber();
     case LESS_EQUAL:
-        checkNumberOperands(expr.oper, left, right);
-        return std::get<double>(left) <= std::get<double>(right);
+        checkNumberOperands(expr.line, left, right);
+        return left.asNumber() <= right.asNumber();
     case EQUAL_EQUAL:
         return isEqual(left, right);
     case BANG_EQUAL:
@@ -105,23 +188,113 @@ Object Interpreter::visitBinaryExpr(Binary& expr) {
 
     return nullptr;
 }
-/*** place holders nullptr**/
-Object Interpreter::visitCallExpr(Call& expr) {
-    return nullptr;
+/*
+** The arguments are evaluated straight into a new frame on the FrameStack,
+** where a function's parameters take them over without being copied.
+**
+** A method called straight from a Get or Super, as in a.m(), isn't bound
+** to its instance: the callee is evaluated with invoking pointing at
+** receiver, and the Get or Super leaves the instance there and gives back
+** the method itself, saving a BoundMethod for every call.
+*/
+Value Interpreter::visitCallExpr(Call& expr) {
+    Value receiver;
+    if(expr.invoke) invoking = &receiver;
+    Value callee = evaluate(expr.callee);
+
+    Environment frame(nullptr, frames, expr.args.size(), expr.line);
+    for(ExprPtr arg : expr.args) frame.define(evaluate(arg));
+
+    if(!callee.isCallable()) throw RuntimeError(expr.line, "Can only call functions and classes.");
+
+    LoxCallable* function = static_cast<LoxCallable*>(callee.asObj());
+    if(expr.args.size() != function->arity())
+        throw RuntimeError(expr.line, "Expected " + std::to_string(function->arity()) +
+                           " arguments but got " + std::to_string(expr.args.size()) + ".");
+
+    if(receiver.isInstance())
+        return callFunction(*static_cast<LoxFunction*>(function), frame, expr.line, &receiver);
+    return function->call(*this, frame, expr.line);
 }
-Object Interpreter::visitGetExpr(Get& expr) {
-    return nullptr;
+
+/* a method's this is the local after its parameters, see Resolver */
+Value Interpreter::callFunction(LoxFunction& function, Environment& frame, unsigned int line,
+                                const Value* receiver) {
+    Function& declaration = function.declaration;
+    if(callDepth == MAX_CALL_DEPTH) throw RuntimeError(line, "Stack overflow.");
+    frame.grow(declaration.slots - declaration.params.size(), line);
+    if(receiver != nullptr) frame.define(*receiver);
+    for(unsigned int param : declaration.boxedParams)
+    {
+        Value& slot = frame.at(0, param);
+        slot = Value::object(new Cell(std::move(slot)));
+    }
+
+    /* interpret() puts these back if a runtime error unwinds past here */
+    LoxFunction* caller = closure;
+    closure = &function;
+    ++callDepth;
+    Completion how = executeBlock(declaration.body, frame);
+    --callDepth;
+    closure = caller;
+
+    if(how == Completion::RETURN) completion = Completion::NORMAL;
+    /* which can only return early, with no value */
+    if(function.initializer) return *receiver;
+    if(how != Completion::RETURN) return nullptr;
+    return std::move(returnValue);
+}
+
+/*
+** A property is found through the node's PropertyCache, so a hit costs one
+** compare of Shape ids and then an indexed load, or for a method no lookup
+** at all. A miss looks the name up in the instance's Shape, then in its
+** class's methods, and caches what it found.
+*/
+Value Interpreter::visitGetExpr(Get& expr) {
+    /* taken before the object, which may make calls of its own */
+    Value* receiver = invoking;
+    invoking = nullptr;
+    Value object = evaluate(expr.object);
+    if(!object.isInstance()) throw RuntimeError(expr.line, "Only instances have properties.");
+    LoxInstance* instance = static_cast<LoxInstance*>(object.asObj());
+
+    Shape* shape = instance->shape;
+    if(const PropertyCache::Entry* entry = expr.cache.find(shape->id))
+    {
+        if(entry->slot != Shape::NONE) return instance->fields[entry->slot];
+        return bind(std::move(object), entry->method, receiver);
+    }
+
+    PropertyCache::Entry entry{shape->id, shape->find(expr.name), {nullptr}};
+    if(entry.slot != Shape::NONE)
+    {
+        expr.cache.add(entry);
+        return instance->fields[entry.slot];
+    }
+
+    entry.method = instance->klass.findMethod(expr.name);
+    if(entry.method == nullptr)
+        throw RuntimeError(expr.line, "Undefined property '" + SymbolTable::name(expr.name) + "'.");
+    expr.cache.add(entry);
+    return bind(std::move(object), entry.method, receiver);
 }
-Object Interpreter::visitGroupingExpr(Grouping& expr) {
+
+Value Interpreter::bind(Value object, LoxFunction* method, Value* receiver) {
+    if(receiver == nullptr) return Value::object(new BoundMethod(std::move(object), Value::object(method)));
+    *receiver = std::move(object);
+    return Value::object(method);
+}
+Value Interpreter::visitGroupingExpr(Grouping& expr) {
     return evaluate(expr.expr);
 }
-Object Interpreter::visitLiteralExpr(Literal& expr) {
+Value Interpreter::visitLiteralExpr(Literal& expr) {
     return expr.value;
 }
-Object Interpreter::visitLogicalExpr(Logical& expr) {
-    Object left = evaluate(expr.left);
+Value Interpreter::visitLogicalExpr(Logical& expr) {
+    Value left = evaluate(expr.left);
 
-    if(expr.oper.type == OR) {
+    if(expr.oper == OR) {
         /* we don't check the second if the first is true */
         if(isTruthy(left)) return left;
     } else { /* operand is and*/
@@ -131,22 +304,72 @@ Object Interpreter::visitLogicalExpr(Logical& expr) {
 
     return evaluate(expr.right);
 }
-Object Interpreter::visitSetExpr(Set& expr) {
-    return nullptr;
+/*
+** As for a Get, but a field that isn't there yet is added, and the cache
+** keeps the Shape that takes the instance to as well as the slot.
+*/
+Value Interpreter::visitSetExpr(Set& expr) {
+    Value object = evaluate(expr.object);
+    if(!object.isInstance()) throw RuntimeError(expr.line, "Only instances have fields.");
+    Value value = evaluate(expr.value);
+    LoxInstance* instance = static_cast<LoxInstance*>(object.asObj());
+
+    /* read after the value, which may have added fields */
+    Shape* shape = instance->shape;
+    PropertyCache::Entry entry;
+    if(const PropertyCache::Entry* cached = expr.cache.find(shape->id)) entry = *cached;
+    else
+    {
+        entry = {shape->id, shape->find(expr.name), nullptr};
+        if(entry.slot == Shape::NONE)
+        {
+            entry.slot = shape->size();
+            entry.transition = shape->add(expr.name);
+        }
+        expr.cache.add(entry);
+    }
+
+    if(entry.transition == nullptr)
+    {
+        instance->fields[entry.slot] = value;
+        return value;
+    }
+    instance->shape = entry.transition;
+    instance->fields.push_back(value);
+    LoxClass& klass = instance->klass;
+    if(instance->fields.size() > klass.fields) klass.fields = instance->fields.size();
+    return value;
 }
-Object Interpreter::visitSuperExpr(Super& expr) {
-    return nullptr;
+/*
+** The superclass is the same every time the node runs unless its class
+** declaration runs again, so the method found in it is cached against the
+** superclass's id.
+*/
+Value Interpreter::visitSuperExpr(Super& expr) {
+    Value* receiver = invoking;
+    invoking = nullptr;
+    LoxClass* superclass = static_cast<LoxClass*>(local(expr.depth, expr.slot).asObj());
+
+    if(expr.cache.klass != superclass->id())
+    {
+        LoxFunction* method = superclass->findMethod(expr.method);
+        if(method == nullptr)
+            throw RuntimeError(expr.line, "Undefined property '" + SymbolTable::name(expr.method) + "'.");
+        expr.cache.klass = superclass->id();
+        expr.cache.method = method;
+    }
+    return bind(local(expr.thisDepth, expr.thisSlot), expr.cache.method, receiver);
 }
-Object Interpreter::visitThisExpr(This& expr) {
-    return nullptr;
+Value Interpreter::visitThisExpr(This& expr) {
+    return local(expr.depth, expr.slot);
 }
-Object Interpreter::visitUnaryExpr(Unary& expr) {
-    Object right = evaluate(expr.right);
-    switch (expr.oper.type)
+Value Interpreter::visitUnaryExpr(Unary& expr) {
+    Value right = evaluate(expr.right);
+    switch (expr.oper)
     {
     case MINUS:
-        checkNumberOperand(expr.oper, right);
-        return -std::get<double>(right);
+        checkNumberOperand(expr.line, right);
+        return -right.asNumber();
         break;
     case BANG:
         return !isTruthy(right);
@@ -156,66 +379,193 @@ Object Interpreter::visitUnaryExpr(Unary& expr) {
 
     return nullptr;
 }
-Object Interpreter::visitVariableExpr(Variable& expr) {
-    return environment->get(expr.name);
+Value Interpreter::visitVariableExpr(Variable& expr) {
+    if(expr.depth == GLOBAL) return globals->get(expr.name, expr.line);
+    if(expr.depth == CALLEE) return Value::object(closure);
+    return local(expr.depth, expr.slot);
 }
 
-std::string Interpreter::stringify(const Object& obj)
+std::string Interpreter::stringify(const Value& obj)
 {
-    if(std::holds_alternative<void*>(obj)) return std::string("nil");
+    if(obj.isNil()) return std::string("nil");
 
-    if(std::holds_alternative<double>(obj)) {
-        double v = std::get<double>(obj);
+    if(obj.isNumber()) {
+        double v = obj.asNumber();
         if(v == static_cast<int>(v))
             return std::string(std::to_string(static_cast<int>(v)));
         else return std::string(std::to_string(v));
 
 
     }
-    if(std::holds_alternative<bool>(obj))
-        return std::get<bool>(obj) ? std::string("true") : std::string("false");
+    if(obj.isBool())
+        return obj.asBool() ? std::string("true") : std::string("false");
 
-    return std::get<std::string>(obj);
-}
+    if(obj.isCallable()) return static_cast<LoxCallable*>(obj.asObj())->toString();
+    /* only the VM and the ClosureCompiler make these, but print them through here too */
+    if(obj.isCompiled()) return static_cast<CompiledFunction*>(obj.asObj())->toString();
+    if(obj.isCode()) return static_cast<CodeFunction*>(obj.asObj())->toString();
 
+    if(obj.isInstance())
+        return SymbolTable::name(static_cast<LoxInstance*>(obj.asObj())->klass.name) + " instance";
 
-void Interpreter::executeBlock(std::vector<StmtPtr>& statements, std::unique_ptr<Environment> env)
-{
+    return obj.asString();
+}
 
+void Interpreter::print(const Value& value)
+{
+    /* strings are written straight from the Value rather than copied by stringify() */
+    if(value.isString()) std::cout << value.asString() << "\n" << std::endl;
+    else std::cout << stringify(value)<< "\n" << std::endl;
+}
 
-    std::unique_ptr<Environment> previous = std::move(environment);
+namespace {
 
-    this->environment.reset();
-    this->environment = std::move(env);
+const char* formName(BinaryForm form)
+{
+    switch(form)
+    {
+    case BinaryForm::UNSEEN: return "unseen";
+    case BinaryForm::GENERIC: return "generic";
+    case BinaryForm::NUMBER_ADD: return "number add";
+    case BinaryForm::NUMBER_SUBTRACT: return "number subtract";
+    case BinaryForm::NUMBER_MULTIPLY: return "number multiply";
+    case BinaryForm::NUMBER_DIVIDE: return "number divide";
+    case BinaryForm::NUMBER_GREATER: return "number greater";
+    case BinaryForm::NUMBER_GREATER_EQUAL: return "number greater-equal";
+    case BinaryForm::NUMBER_LESS: return "number less";
+    case BinaryForm::NUMBER_LESS_EQUAL: return "number less-equal";
+    case BinaryForm::STRING_CONCAT: return "string concat";
+    }
+    return "?";
+}
 
-    try {
-        for(auto it = statements.begin(); it != statements.end(); ++it)
-        {
-            execute(*it);
-        }
+} // namespace
 
+/* one line per node, in the order they were first rewritten */
+void Interpreter::reportRewrites(std::ostream& out)
+{
+    out << "Binary node rewrites: " << rewrites.size() << std::endl;
+    for(const Rewrites& node : rewrites)
+    {
+        out << "  [line " << node.line << "] " << AstNodePrinter::spelling(node.oper) << "  "
+            << formName(node.first);
+        if(node.form != node.first) out << " -> " << formName(node.form);
+        out << std::endl;
     }
-    catch(RuntimeError& e) {
-        environment = std::move(previous);
-        throw;
-    }
-
-    environment = std::move(previous);
+    rewrites.clear();
+    rewritten.clear();
+}
 
+Completion Interpreter::executeBlock(ArenaList<StmtPtr> statements, Environment& env)
+{
+    EnterScope scope(environment, env);
+    for(StmtPtr statement : statements)
+    {
+        if(execute(statement) != Completion::NORMAL) break;
+    }
+    return completion;
 }
 void Interpreter::visitBlockStmt(Block& stmt) {
-    executeBlock(stmt.statements,
-                 std::move(std::unique_ptr<Environment>(new Environment(environment.get()))));
+    /* the scope's frame is taken from, and given back to, the frame stack */
+    Environment scope(environment, frames, stmt.slots, stmt.line);
+    executeBlock(stmt.statements, scope);
+}
+void Interpreter::visitBreakStmt(Break& stmt) {
+    completion = Completion::BREAK;
 }
+/*
+** Methods may use the class's name, so, as for a function, a boxed one is
+** defined first. A subclass's methods are made in a scope of their own,
+** holding super in a Cell, see Resolver.
+*/
 void Interpreter::visitClassStmt(Class& stmt) {
+    Value superclass;
+    if(stmt.superclass != nullptr)
+    {
+        superclass = evaluate(stmt.superclass);
+        if(!superclass.isClass()) throw RuntimeError(stmt.superclass->line, "Superclass must be a class.");
+    }
+
+    LoxClass* klass = new LoxClass(stmt.name);
+    Value value = Value::object(klass);
 
+    Cell* cell = nullptr;
+    if(environment != nullptr && stmt.boxed)
+    {
+        cell = new Cell(nullptr);
+        environment->define(Value::object(cell));
+    }
+
+    if(stmt.superclass == nullptr) defineMethods(stmt, *klass);
+    else
+    {
+        klass->methods = static_cast<LoxClass*>(superclass.asObj())->methods;
+        Environment scope(environment, frames, 1, stmt.line);
+        scope.define(Value::object(new Cell(std::move(superclass))));
+        EnterScope enter(environment, scope);
+        defineMethods(stmt, *klass);
+    }
+    klass->initializer = klass->findMethod(initName);
+
+    if(environment == nullptr) globals->define(stmt.name, std::move(value));
+    else if(cell != nullptr) cell->value = std::move(value);
+    else environment->define(std::move(value));
+}
+void Interpreter::visitContinueStmt(Continue& stmt) {
+    completion = Completion::CONTINUE;
 }
 void Interpreter::visitExpressionStmt(Expression& stmt) {
     evaluate(stmt.expression);
 }
 
+/*
+** A function that captures its own name finds it already declared, so the
+** name is defined first if it is boxed; an unboxed slot is only pointed to.
+*/
 void Interpreter::visitFunctionStmt(Function& stmt) {
+    LoxFunction* function = new LoxFunction(stmt);
+    Value value = Value::object(function);
+    if(environment == nullptr)
+    {
+        globals->define(stmt.name, std::move(value));
+        return;
+    }
+
+    Cell* cell = nullptr;
+    if(stmt.boxed)
+    {
+        cell = new Cell(nullptr);
+        environment->define(Value::object(cell));
+    }
 
+    capture(*function);
+    if(cell != nullptr) cell->value = std::move(value);
+    else environment->define(std::move(value));
+}
+
+void Interpreter::defineMethods(Class& stmt, LoxClass& klass) {
+    for(FunPtr method : stmt.methods)
+    {
+        LoxFunction* function = new LoxFunction(*method);
+        function->initializer = method->name == initName;
+        capture(*function);
+        klass.methods.insert_or_assign(method->name, Value::object(function));
+    }
+}
+
+void Interpreter::capture(LoxFunction& function) {
+    ArenaList<Capture> captures = function.declaration.captures;
+    function.upvalues.reserve(captures.size());
+    for(const Capture& capture : captures)
+    {
+        if(!capture.local) function.upvalues.push_back(closure->upvalues[capture.slot]);
+        else if(!capture.boxed) function.upvalues.push_back({&environment->at(capture.depth, capture.slot), nullptr});
+        else
+        {
+            Value& boxed = environment->at(capture.depth, capture.slot);
+            function.upvalues.push_back({&static_cast<Cell*>(boxed.asObj())->value, boxed});
+        }
+    }
 }
 void Interpreter::visitIfStmt(If& stmt) {
     if(isTruthy(evaluate(stmt.condition))) execute(stmt.thenBranch);
@@ -224,28 +574,39 @@ void Interpreter::visitIfStmt(If& stmt) {
     }
 }
 void Interpreter::visitPrintStmt(Print& stmt) {
-    std::cout << stringify(evaluate(stmt.expression))<< "\n" << std::endl;
+    print(evaluate(stmt.expression));
 }
 void Interpreter::visitReturnStmt(Return& stmt) {
-
+    returnValue = stmt.value != nullptr ? evaluate(stmt.value) : nullptr;
+    completion = Completion::RETURN;
 }
 void Interpreter::visitVarStmt(Var& stmt) {
-    Object value = nullptr;
+    Value value = nullptr;
     if(stmt.initializer != nullptr)
     {
         value = evaluate(stmt.initializer);
     }
-    environment->define(stmt.name.lexeme, value);
+    /* outside any block, i.e. at the top level */
+    if(environment == nullptr) globals->define(stmt.name, std::move(value));
+    else if(stmt.boxed) environment->define(Value::object(new Cell(std::move(value))));
+    else environment->define(std::move(value));
 }
+/* a return is left for the call to pick up, break and continue stop here */
 void Interpreter::visitWhileStmt(While& stmt) {
     while(isTruthy(evaluate(stmt.condition))) {
-        execute(stmt.body);
+        Completion how = execute(stmt.body);
+        if(how == Completion::RETURN) return;
+        completion = Completion::NORMAL;
+        if(how == Completion::BREAK) return;
+
+        if(stmt.increment != nullptr) evaluate(stmt.increment);
     }
 }
 
-void Interpreter::execute(StmtPtr& statement)
+Completion Interpreter::execute(StmtPtr statement)
 {
     statement->accept(*this);
+    return completion;
 }
 void Interpreter::interpret(std::vector<StmtPtr>& statements) {
     try {
@@ -259,6 +620,10 @@ void Interpreter::interpret(std::vector<StmtPtr>& statements) {
     }
     catch(const RuntimeError& err)
     {
+        callDepth = 0;
+        closure = nullptr;
+        invoking = nullptr;
+        completion = Completion::NORMAL;
         Lox::runtimeError(err);
     }
 }
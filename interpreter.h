@@ -2,32 +2,62 @@
 #define LOX_INTERPRETER_H
 
 
+#include<memory>
+#include<ostream>
+#include<unordered_map>
+#include<vector>
+
+#include"callable.h"
+#include"environment.h"
 #include"expr.h"
+#include"instance.h"
 #include"stmt.h"
 
 namespace lox {
 
-class Environment;
 
+/*
+** How a statement finished. Anything but NORMAL makes the statements around
+** it stop and pass it up: break and continue to the innermost loop, return
+** to the call, which each put it back to NORMAL.
+*/
+enum class Completion : unsigned char { NORMAL, BREAK, CONTINUE, RETURN };
+
+/*
+** Walks the tree. Executing a statement gives its Completion, so leaving a
+** loop or function early throws nothing; a return leaves its value in
+** returnValue for the call. Only a RuntimeError is thrown, and since it
+** ends the Program it is caught once, in interpret(), with each scope put
+** back on the way by EnterScope. Calls nest on the C++ stack, so their
+** depth is limited to keep it from overflowing.
+**
+** A function's frame doesn't enclose anything: a block inside it reaches
+** the function's own locals through the Environment chain, and those of
+** enclosing functions through the upvalues of the closure being run.
+*/
 class Interpreter : public ExprVisitor, StmtVisitor {
 public:
+    static constexpr unsigned int MAX_CALL_DEPTH = 1000;
+
     Interpreter();
     ~Interpreter();
-    virtual Object visitAssignExpr(Assign& expr)override;
-    virtual Object visitBinaryExpr(Binary& expr)override;
-    virtual Object visitCallExpr(Call& expr)override;
-    virtual Object visitGetExpr(Get& expr)override;
-    virtual Object visitGroupingExpr(Grouping& expr)override;
-    virtual Object visitLiteralExpr(Literal& expr)override;
-    virtual Object visitLogicalExpr(Logical& expr)override;
-    virtual Object visitSetExpr(Set& expr)override;
-    virtual Object visitSuperExpr(Super& expr)override;
-    virtual Object visitThisExpr(This& expr)override;
-    virtual Object visitUnaryExpr(Unary& expr)override;
-    virtual Object visitVariableExpr(Variable& expr)override;
+    virtual Value visitAssignExpr(Assign& expr)override;
+    virtual Value visitBinaryExpr(Binary& expr)override;
+    virtual Value visitCallExpr(Call& expr)override;
+    virtual Value visitGetExpr(Get& expr)override;
+    virtual Value visitGroupingExpr(Grouping& expr)override;
+    virtual Value visitLiteralExpr(Literal& expr)override;
+    virtual Value visitLogicalExpr(Logical& expr)override;
+    virtual Value visitSetExpr(Set& expr)override;
+    virtual Value visitSuperExpr(Super& expr)override;
+    virtual Value visitThisExpr(This& expr)override;
+    virtual Value visitUnaryExpr(Unary& expr)override;
+    virtual Value visitVariableExpr(Variable& expr)override;
 
     virtual void visitBlockStmt(Block& stmt)override;
+    virtual void visitBreakStmt(Break& stmt)override;
     virtual void visitClassStmt(Class& stmt)override;
+    virtual void visitContinueStmt(Continue& stmt)override;
     virtual void visitExpressionStmt(Expression& stmt)override;
     virtual void visitFunctionStmt(Function& stmt)override;
     virtual void visitIfStmt(If& stmt)override;
@@ -36,17 +66,80 @@ public:
     virtual void visitVarStmt(Var& stmt)override;
     virtual void visitWhileStmt(While& stmt)override;
 
-    void execute(StmtPtr& expr);
-    void executeBlock(std::vector<StmtPtr>& statements, std::unique_ptr<Environment> environment);
-    Object evaluate(ExprPtr& expr);
-    bool isTruthy(const Object& obj);
-    bool isEqual(const Object& a, const Object& b);
-    void checkNumberOperand(const Token& oper, const Object& operand);
-    void checkNumberOperands(const Token& oper, const Object& left, const Object& right);
+    Completion execute(StmtPtr expr);
+    Completion executeBlock(ArenaList<StmtPtr> statements, Environment& environment);
+    Value evaluate(ExprPtr expr);
+    bool isTruthy(const Value& obj);
+    bool isEqual(const Value& a, const Value& b);
+    void checkNumberOperand(unsigned int line, const Value& operand);
+    void checkNumberOperands(unsigned int line, const Value& left, const Value& right);
     void interpret(std::vector<StmtPtr>& expr);
-    std::string stringify(const Object& expr);
+    /*
+    ** Runs function's body in frame, which holds the arguments, see
+    ** LoxCallable. A method is given the instance it runs on as receiver.
+    */
+    Value callFunction(LoxFunction& function, Environment& frame, unsigned int line,
+                       const Value* receiver = nullptr);
+    static std::string stringify(const Value& expr);
+    /* what a print statement writes for value */
+    static void print(const Value& value);
+
+    /* keep track of how Binary nodes are rewritten, see BinaryForm */
+    void recordRewrites(bool on) {
+        recording = on;
+    }
+    /* lists the nodes rewritten since the last report, then forgets them */
+    void reportRewrites(std::ostream& out);
 private:
-    std::unique_ptr<Environment> environment;
+    /* a variable the Resolver found in a local scope, wherever it lives */
+    Value& local(unsigned int depth, unsigned int slot) {
+        if(depth < BOXED) return environment->at(depth, slot);
+        if(depth == UPVALUE) return *closure->upvalues[slot].value;
+        return static_cast<Cell*>(environment->at(depth - BOXED, slot).asObj())->value;
+    }
+
+    /* gives a new closure its upvalues, from the scope it is declared in */
+    void capture(LoxFunction& function);
+    /* adds stmt's own methods to klass's table */
+    void defineMethods(Class& stmt, LoxClass& klass);
+    /*
+    ** method, bound to object; or, if the call that asked for it gave a
+    ** receiver to fill in, method itself, see visitCallExpr
+    */
+    static Value bind(Value object, LoxFunction* method, Value* receiver);
+
+    static BinaryForm specialize(TokenType oper, const Value& left, const Value& right);
+    void rewrite(Binary& expr, BinaryForm form);
+
+    /* what happened to one node, kept by value as its Program may go first */
+    struct Rewrites {
+        unsigned int line;
+        TokenType oper;
+        /* the form it was first specialized into */
+        BinaryForm first;
+        /* and the one it is in now */
+        BinaryForm form;
+    };
+    bool recording = false;
+    std::vector<Rewrites> rewrites;
+    std::unordered_map<const Binary*, std::size_t> rewritten;
+
+    /* the innermost local scope, nullptr at the top level */
+    Environment* environment = nullptr;
+    /* the function being run, nullptr at the top level */
+    LoxFunction* closure = nullptr;
+    FrameStack frames;
+    std::unique_ptr<Globals> globals;
+
+    /* how the last statement executed finished, see Completion */
+    Completion completion = Completion::NORMAL;
+    /* set by a return statement until the call picks it up */
+    Value returnValue;
+    unsigned int callDepth = 0;
+    /* the name of a class's initializer */
+    const Symbol initName;
+    /* where the Get or Super being called is to leave its receiver, see visitCallExpr */
+    Value* invoking = nullptr;
 
 };
 
@@ -1,9 +1,16 @@
-#include<sstream>
-
+#include"astcache.h"
+#include"chunk.h"
+#include"closurecompiler.h"
+#include"compiler.h"
 #include"environment.h"
 #include"lox.h"
 #include"scanner.h"
+#include"parallelscanner.h"
+#include"optimizer.h"
 #include"parser.h"
+#include"resolver.h"
+#include"source.h"
+#include"vm.h"
 
 
 namespace lox
@@ -17,38 +24,77 @@ void Lox::runPrompt()
     {
         std::cout << "> ";
         std::string input;
-        std::getline(std::cin, input);
+        if(!std::getline(std::cin, input)) break;
         run(input);
         hadError = false;
     }
 }
 
 
-void Lox::run(const std::string& buf)
+void Lox::run(std::string_view buf)
 {
 
     if(hadError) exit(-1);
 
-    auto scanner = std::unique_ptr<Scanner>(new Scanner(buf));
+    auto program = parse(buf);
+
+    if(hadError) return;
+
+    interpret(*program);
+    programs.push_back(std::move(program));
+
+}
+
 
-    auto tokens = scanner->scanTokens();
+std::unique_ptr<Program> Lox::parse(std::string_view buf)
+{
+    std::unique_ptr<TokenSource> scanner;
+    if(options.parallelLex) scanner.reset(new ParallelScanner(buf, 0, options.lexChunk));
+    else scanner.reset(new Scanner(buf));
+
+    auto parser = std::make_unique<Parser>(*scanner);
 
-    auto parser = std::make_unique<Parser>(tokens);
+    return parser->parse();
+}
 
-    auto statements = parser->parse();
 
+void Lox::interpret(Program& program)
+{
+    Resolver(program.arena).resolve(program.statements);
     if(hadError) return;
 
-    static std::unique_ptr<Interpreter> interpreter = std::make_unique<Interpreter>();
-    interpreter->interpret(statements);
+    /* only a script file is known to be the whole program */
+    if(options.optimize) Optimizer(program, !source.empty()).optimize();
 
+    if(options.engine == Engine::VM)
+    {
+        /* the chunk holds on to the constants, the Program isn't needed to run it */
+        Chunk chunk;
+        Compiler(chunk).compile(program.statements);
+        if(hadError) return;
+        static std::unique_ptr<VM> vm = std::make_unique<VM>();
+        vm->interpret(chunk);
+        return;
+    }
+
+    if(options.engine == Engine::CLOSURE)
+    {
+        static std::unique_ptr<ClosureCompiler> closures = std::make_unique<ClosureCompiler>();
+        closures->execute(program.statements);
+        return;
+    }
+
+    static std::unique_ptr<Interpreter> interpreter = std::make_unique<Interpreter>();
+    interpreter->recordRewrites(options.quickenStats);
+    interpreter->interpret(program.statements);
+    if(options.quickenStats) interpreter->reportRewrites(std::cerr);
 }
 
 
 void Lox::error(const Token& token, const std::string& msg)
 {
     if(token.type == END_OF_FILE) report(token.line, " at end", msg);
-    else report(token.line," at '" + token.lexeme + "'", msg);
+    else report(token.line," at '" + std::string(token.lexeme) + "'", msg);
 }
 
 void Lox::report(int line, const std::string& where, const std::string& message)
@@ -61,14 +107,33 @@ void Lox::report(int line, const std::string& where, const std::string& message)
 
 void Lox::runFile()
 {
-    std::ostringstream buf;
-    std::ifstream inputStream(source);
-
-    buf << inputStream.rdbuf();
+    /* tokens refer into the mapped file, so it stays alive until we're done */
+    std::unique_ptr<Source> file = Source::fromFile(source);
+    if(file == nullptr)
+    {
+        std::cerr << "Could not open file '" << source << "'." << std::endl;
+        std::exit(-1);
+    }
 
     if(hadError) std::exit(-1);
     if(hadRuntimeError) std::exit(-2);
 
-    run(buf.str());
+    if(options.astCache.empty())
+    {
+        run(file->text());
+        return;
+    }
+
+    /* a hit skips the Scanner and Parser; only scripts that parse cleanly are stored */
+    AstCache cache(options.astCache);
+    std::unique_ptr<Program> program = cache.load(file->text());
+    if(program == nullptr)
+    {
+        program = parse(file->text());
+        if(hadError) return;
+        cache.store(file->text(), *program);
+    }
+    interpret(*program);
+    programs.push_back(std::move(program));
 }
 }// namespace lox
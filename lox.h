@@ -3,30 +3,59 @@
 
 #include<fstream>
 #include<iostream>
+#include<memory>
 #include<string>
+#include<string_view>
+#include<vector>
 
 #include"interpreter.h"
+#include"runtimeerror.h"
+#include"stmt.h"
 #include"token.h"
 
 namespace lox
 {
 
+/* what runs a Program once it is parsed */
+enum class Engine {
+    TREE,   /* the Interpreter, walking the AST */
+    VM,     /* the Compiler to bytecode, then the VM; no closures or classes */
+    CLOSURE /* the ClosureCompiler; no closures or classes */
+};
+
+/* switches set from the command line, see main.cpp */
+struct Options {
+    /* lex files with the ParallelScanner, in chunks of lexChunk bytes if not 0 */
+    bool parallelLex = false;
+    unsigned int lexChunk = 0;
+    /* directory of the AstCache for script files, empty to parse every time */
+    std::string astCache;
+    /* run the Optimizer over each Program before interpreting it */
+    bool optimize = true;
+    Engine engine = Engine::TREE;
+    /* list how the Interpreter specialized Binary nodes, see BinaryForm */
+    bool quickenStats = false;
+};
+
 class Lox {
 public:
     Lox():source("") {};
     Lox(const Lox&) = delete; /* prohibit copying */
-    Lox(const std::string& source): source(source) {};
+    Lox(const std::string& source, const Options& options = Options()):
+        source(source), options(options) {};
     ~Lox() = default;
     void runFile();
     void runPrompt();
-    void run(const std::string& buf);
+    void run(std::string_view buf);
+    std::unique_ptr<Program> parse(std::string_view buf);
+    void interpret(Program& program);
     static void error(int line, const std::string& message)
     {
         report(line, "", message);
     }
     static void runtimeError(const RuntimeError& err) {
         std::cerr << err.message() <<
-                  "\n[line " << err.token.line << "]" << std::endl;
+                  "\n[line " << err.line << "]" << std::endl;
         hadRuntimeError = true;
     }
     static void error(const Token& token, const std::string& msg);
@@ -37,6 +66,9 @@ public:
 
 private:
     std::string source;
+    Options options;
+    /* functions point into the tree they were declared in, so every Program run is kept */
+    std::vector<std::unique_ptr<Program>> programs;
 
 
 };
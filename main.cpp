@@ -1,18 +1,52 @@
+#include<cstdlib>
+#include<cstring>
 #include<iostream>
 #include<memory>
 
+#include"astcache.h"
 #include"lox.h"
 
+static void usage()
+{
+    std::cerr << "Usage: cpplox [--parallel-lex] [--ast-cache[=dir]] [--no-optimize] [--engine=tree|vm|closure] [--quicken-stats] [script]\n"
+                 "  --engine=tree     runs everything (the default)\n"
+                 "  --engine=vm       runs functions, but not closures or classes\n"
+                 "  --engine=closure  runs functions, but not closures or classes" << std::endl;
+    std::exit(64);
+}
 
 int main(int argc, char** argv)
 {
-    if(argc < 2) {
-        auto lox = std::make_unique<lox::Lox>();
+    lox::Options options;
+    const char* script = nullptr;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(std::strcmp(argv[i], "--parallel-lex") == 0) options.parallelLex = true;
+        else if(std::strcmp(argv[i], "--no-optimize") == 0) options.optimize = false;
+        else if(std::strcmp(argv[i], "--engine=tree") == 0) options.engine = lox::Engine::TREE;
+        else if(std::strcmp(argv[i], "--engine=vm") == 0) options.engine = lox::Engine::VM;
+        else if(std::strcmp(argv[i], "--engine=closure") == 0) options.engine = lox::Engine::CLOSURE;
+        else if(std::strcmp(argv[i], "--quicken-stats") == 0) options.quickenStats = true;
+        else if(std::strcmp(argv[i], "--ast-cache") == 0) options.astCache = lox::AstCache::defaultDirectory();
+        else if(std::strncmp(argv[i], "--ast-cache=", 12) == 0 && argv[i][12] != '\0') options.astCache = argv[i] + 12;
+        /* not in the usage: small chunks put chunk boundaries all over the tests */
+        else if(std::strncmp(argv[i], "--parallel-lex-chunk=", 21) == 0 && std::atoi(argv[i] + 21) > 0)
+        {
+            options.parallelLex = true;
+            options.lexChunk = std::atoi(argv[i] + 21);
+        }
+        else if(argv[i][0] == '-' || script != nullptr) usage();
+        else script = argv[i];
+    }
+
+    if(script == nullptr) {
+        auto lox = std::make_unique<lox::Lox>("", options);
         lox->runPrompt();
     }
     else
     {
-        auto lox = std::make_unique<lox::Lox>(argv[1]);
+        auto lox = std::make_unique<lox::Lox>(script, options);
         lox->runFile();
     }
 
@@ -0,0 +1,323 @@
+#include"optimizer.h"
+#include"runtimeerror.h"
+
+namespace lox {
+
+void Optimizer::optimize()
+{
+    for(int pass = 0; pass < 2; ++pass)
+    {
+        propagate = pass == 1;
+        beginScope();
+        std::size_t kept = 0;
+        for(StmtPtr stmt : program.statements)
+        {
+            if(StmtPtr s = rewrite(stmt)) program.statements[kept++] = s;
+        }
+        program.statements.resize(kept);
+        endScope();
+    }
+}
+
+ExprPtr Optimizer::rewrite(ExprPtr expr)
+{
+    if(expr == nullptr) return nullptr;
+    expression = expr;
+    expr->accept(*this);
+    return expression;
+}
+
+StmtPtr Optimizer::rewrite(StmtPtr stmt)
+{
+    if(stmt == nullptr) return nullptr;
+    statement = stmt;
+    stmt->accept(*this);
+    return statement;
+}
+
+StmtPtr Optimizer::rewriteBody(StmtPtr stmt)
+{
+    StmtPtr s = rewrite(stmt);
+    return s != nullptr ? s : program.arena.make<Block>(ArenaList<StmtPtr>(), 0);
+}
+
+/* statements that were removed are squeezed out of the list in place */
+ArenaList<StmtPtr> Optimizer::rewrite(ArenaList<StmtPtr> statements)
+{
+    std::size_t kept = 0;
+    for(StmtPtr stmt : statements)
+    {
+        if(StmtPtr s = rewrite(stmt)) statements[kept++] = s;
+    }
+    return ArenaList<StmtPtr>(statements.begin(), kept);
+}
+
+Literal* Optimizer::literal(ExprPtr expr)
+{
+    return dynamic_cast<Literal*>(expr);
+}
+
+ExprPtr Optimizer::fold(Expr& expr)
+{
+    try {
+        Literal* folded = program.arena.make<Literal>(evaluator.evaluate(&expr));
+        folded->line = expr.line;
+        return folded;
+    }
+    catch(const RuntimeError&) {
+        /* leave it to fail when the program runs */
+        return &expr;
+    }
+}
+
+void Optimizer::beginScope()
+{
+    scopes.push_back(Scope{ {}, functionDepth });
+}
+
+void Optimizer::endScope()
+{
+    scopes.pop_back();
+}
+
+void Optimizer::declare(Symbol name, Var* declaration)
+{
+    if(scopes.size() == 1 && !wholeProgram) declaration = nullptr;
+
+    auto [it, added] = scopes.back().names.try_emplace(name, declaration);
+    if(added) return;
+    if(it->second != nullptr) variable.insert(it->second);
+    if(declaration != nullptr) variable.insert(declaration);
+    it->second = declaration;
+}
+
+Var* Optimizer::resolve(Symbol name, bool& local)
+{
+    for(auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope)
+    {
+        auto it = scope->names.find(name);
+        if(it == scope->names.end()) continue;
+        local = scope->function == functionDepth;
+        return it->second;
+    }
+    local = false;
+    return nullptr;
+}
+
+void Optimizer::function(Function& stmt)
+{
+    ++functionDepth;
+    beginScope();
+    for(Symbol param : stmt.params) declare(param, nullptr);
+    stmt.body = rewrite(stmt.body);
+    endScope();
+    --functionDepth;
+}
+
+Value Optimizer::visitAssignExpr(Assign& expr)
+{
+    expr.value = rewrite(expr.value);
+    bool local;
+    if(Var* declaration = resolve(expr.name, local)) variable.insert(declaration);
+    expression = &expr;
+    return nullptr;
+}
+
+Value Optimizer::visitBinaryExpr(Binary& expr)
+{
+    expr.left = rewrite(expr.left);
+    expr.right = rewrite(expr.right);
+    expression = &expr;
+    if(literal(expr.left) == nullptr) return nullptr;
+
+    if(expr.oper == COMMA) expression = expr.right;
+    else if(literal(expr.right) != nullptr) expression = fold(expr);
+    return nullptr;
+}
+
+Value Optimizer::visitCallExpr(Call& expr)
+{
+    expr.callee = rewrite(expr.callee);
+    for(ExprPtr& arg : expr.args) arg = rewrite(arg);
+    expression = &expr;
+    return nullptr;
+}
+
+Value Optimizer::visitGetExpr(Get& expr)
+{
+    expr.object = rewrite(expr.object);
+    expression = &expr;
+    return nullptr;
+}
+
+/* parentheses only matter to the parser */
+Value Optimizer::visitGroupingExpr(Grouping& expr)
+{
+    expression = rewrite(expr.expr);
+    return nullptr;
+}
+
+Value Optimizer::visitLiteralExpr(Literal& expr)
+{
+    expression = &expr;
+    return nullptr;
+}
+
+/* a literal left operand decides which operand is the result */
+Value Optimizer::visitLogicalExpr(Logical& expr)
+{
+    expr.left = rewrite(expr.left);
+    expr.right = rewrite(expr.right);
+    expression = &expr;
+    if(Literal* left = literal(expr.left))
+    {
+        if(evaluator.isTruthy(left->value) == (expr.oper == OR)) expression = expr.left;
+        else expression = expr.right;
+    }
+    return nullptr;
+}
+
+Value Optimizer::visitSetExpr(Set& expr)
+{
+    expr.object = rewrite(expr.object);
+    expr.value = rewrite(expr.value);
+    expression = &expr;
+    return nullptr;
+}
+
+Value Optimizer::visitSuperExpr(Super& expr)
+{
+    expression = &expr;
+    return nullptr;
+}
+
+Value Optimizer::visitThisExpr(This& expr)
+{
+    expression = &expr;
+    return nullptr;
+}
+
+Value Optimizer::visitUnaryExpr(Unary& expr)
+{
+    expr.right = rewrite(expr.right);
+    expression = &expr;
+    if(literal(expr.right) != nullptr) expression = fold(expr);
+    return nullptr;
+}
+
+/*
+** Reads are only replaced within the function that declares the variable:
+** a function can run after a later declaration of the same name in its
+** enclosing scope, which then shadows this one.
+*/
+Value Optimizer::visitVariableExpr(Variable& expr)
+{
+    expression = &expr;
+    if(!propagate) return nullptr;
+
+    bool local;
+    Var* declaration = resolve(expr.name, local);
+    if(declaration == nullptr || !local || variable.count(declaration) != 0) return nullptr;
+
+    if(declaration->initializer == nullptr)
+    {
+        Literal* nil = program.arena.make<Literal>(nullptr);
+        nil->line = expr.line;
+        expression = nil;
+    }
+    else if(literal(declaration->initializer) != nullptr)
+    {
+        /* literals are never changed, so all the reads can share it */
+        expression = declaration->initializer;
+    }
+    return nullptr;
+}
+
+void Optimizer::visitBlockStmt(Block& stmt)
+{
+    beginScope();
+    stmt.statements = rewrite(stmt.statements);
+    endScope();
+    statement = stmt.statements.empty() ? nullptr : &stmt;
+}
+
+void Optimizer::visitBreakStmt(Break& stmt)
+{
+    statement = &stmt;
+}
+
+void Optimizer::visitClassStmt(Class& stmt)
+{
+    declare(stmt.name, nullptr);
+    for(FunPtr method : stmt.methods) function(*method);
+    statement = &stmt;
+}
+
+void Optimizer::visitContinueStmt(Continue& stmt)
+{
+    statement = &stmt;
+}
+
+void Optimizer::visitExpressionStmt(Expression& stmt)
+{
+    stmt.expression = rewrite(stmt.expression);
+    statement = literal(stmt.expression) != nullptr ? nullptr : &stmt;
+}
+
+void Optimizer::visitFunctionStmt(Function& stmt)
+{
+    declare(stmt.name, nullptr);
+    function(stmt);
+    statement = &stmt;
+}
+
+void Optimizer::visitIfStmt(If& stmt)
+{
+    stmt.condition = rewrite(stmt.condition);
+    if(Literal* condition = literal(stmt.condition))
+    {
+        statement = evaluator.isTruthy(condition->value) ? rewrite(stmt.thenBranch)
+                    : rewrite(stmt.elseBranch);
+        return;
+    }
+    stmt.thenBranch = rewriteBody(stmt.thenBranch);
+    stmt.elseBranch = rewrite(stmt.elseBranch);
+    statement = &stmt;
+}
+
+void Optimizer::visitPrintStmt(Print& stmt)
+{
+    stmt.expression = rewrite(stmt.expression);
+    statement = &stmt;
+}
+
+void Optimizer::visitReturnStmt(Return& stmt)
+{
+    stmt.value = rewrite(stmt.value);
+    statement = &stmt;
+}
+
+void Optimizer::visitVarStmt(Var& stmt)
+{
+    stmt.initializer = rewrite(stmt.initializer);
+    declare(stmt.name, &stmt);
+    statement = &stmt;
+}
+
+void Optimizer::visitWhileStmt(While& stmt)
+{
+    stmt.condition = rewrite(stmt.condition);
+    Literal* condition = literal(stmt.condition);
+    if(condition != nullptr && !evaluator.isTruthy(condition->value))
+    {
+        statement = nullptr;
+        return;
+    }
+    stmt.body = rewriteBody(stmt.body);
+    /* as with an expression statement, a literal increment does nothing */
+    stmt.increment = rewrite(stmt.increment);
+    if(literal(stmt.increment) != nullptr) stmt.increment = nullptr;
+    statement = &stmt;
+}
+
+} // namespace lox
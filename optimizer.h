@@ -0,0 +1,109 @@
+#ifndef LOX_OPTIMIZER_H
+#define LOX_OPTIMIZER_H
+
+#include<unordered_map>
+#include<unordered_set>
+#include<vector>
+
+#include"expr.h"
+#include"interpreter.h"
+#include"stmt.h"
+
+namespace lox {
+
+/*
+** Rewrites a parsed Program before it is interpreted, without changing what
+** it prints or which runtime errors it reports:
+**
+**   - Binary, Unary and Logical nodes whose operands are literals are folded
+**     into a Literal, and Groupings are dropped. An operation that would
+**     throw (e.g. "a" - 1) is left alone so it still fails at run time.
+**   - A variable that is declared once in its scope with a literal
+**     initializer (or none, making it nil) and never assigned is replaced by
+**     that literal wherever it is read in the same function.
+**   - An If or While whose condition folds to a literal loses the branch
+**     that can't run.
+**
+** It takes two passes: the first folds and prunes and finds the assigned
+** and redeclared variables, the second does all three again now that the
+** variables which can be propagated are known.
+**
+** Top-level variables are only propagated when the Program is a whole file;
+** a REPL line can be followed by others that assign them.
+*/
+class Optimizer : public ExprVisitor, public StmtVisitor {
+public:
+    Optimizer(Program& program, bool wholeProgram):
+        program(program), wholeProgram(wholeProgram) {}
+    Optimizer(const Optimizer&) = delete;
+
+    void optimize();
+
+    Value visitAssignExpr(Assign& expr) override;
+    Value visitBinaryExpr(Binary& expr) override;
+    Value visitCallExpr(Call& expr) override;
+    Value visitGetExpr(Get& expr) override;
+    Value visitGroupingExpr(Grouping& expr) override;
+    Value visitLiteralExpr(Literal& expr) override;
+    Value visitLogicalExpr(Logical& expr) override;
+    Value visitSetExpr(Set& expr) override;
+    Value visitSuperExpr(Super& expr) override;
+    Value visitThisExpr(This& expr) override;
+    Value visitUnaryExpr(Unary& expr) override;
+    Value visitVariableExpr(Variable& expr) override;
+
+    void visitBlockStmt(Block& stmt) override;
+    void visitBreakStmt(Break& stmt) override;
+    void visitClassStmt(Class& stmt) override;
+    void visitContinueStmt(Continue& stmt) override;
+    void visitExpressionStmt(Expression& stmt) override;
+    void visitFunctionStmt(Function& stmt) override;
+    void visitIfStmt(If& stmt) override;
+    void visitPrintStmt(Print& stmt) override;
+    void visitReturnStmt(Return& stmt) override;
+    void visitVarStmt(Var& stmt) override;
+    void visitWhileStmt(While& stmt) override;
+
+private:
+    /* a declaration is nullptr for names that can never be propagated, e.g. parameters */
+    struct Scope {
+        std::unordered_map<Symbol, Var*> names;
+        unsigned int function;
+    };
+
+    /* the visitors leave the node to put in place of the one visited here */
+    ExprPtr rewrite(ExprPtr expr);
+    StmtPtr rewrite(StmtPtr stmt);
+    /* a statement that must be there, so a removed one becomes an empty block */
+    StmtPtr rewriteBody(StmtPtr stmt);
+    ArenaList<StmtPtr> rewrite(ArenaList<StmtPtr> statements);
+
+    ExprPtr fold(Expr& expr);
+    static Literal* literal(ExprPtr expr);
+
+    void beginScope();
+    void endScope();
+    void declare(Symbol name, Var* declaration);
+    /* the declaration name refers to here, and whether that is in this function */
+    Var* resolve(Symbol name, bool& local);
+    void function(Function& stmt);
+
+    Program& program;
+    bool wholeProgram;
+    bool propagate = false;
+
+    ExprPtr expression = nullptr;
+    StmtPtr statement = nullptr;
+
+    std::vector<Scope> scopes;
+    unsigned int functionDepth = 0;
+    /* declarations that are assigned or share their scope with another of the same name */
+    std::unordered_set<Var*> variable;
+
+    /* folds by evaluating literal-only subtrees, so the results match exactly */
+    Interpreter evaluator;
+};
+
+} // namespace lox
+
+#endif
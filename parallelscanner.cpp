@@ -0,0 +1,204 @@
+#include<algorithm>
+#include<atomic>
+#include<thread>
+#include<unordered_map>
+
+#include"lox.h"
+#include"parallelscanner.h"
+
+namespace lox {
+
+namespace {
+
+/* below this a file isn't worth splitting */
+constexpr unsigned int MIN_CHUNK = 256 * 1024;
+/* more chunks than threads, so a slow chunk doesn't hold everyone up */
+constexpr unsigned int CHUNKS_PER_THREAD = 4;
+
+/* run fn(0) ... fn(n - 1) on up to 'threads' threads */
+template<typename Fn>
+void parallelFor(std::size_t n, unsigned int threads, Fn fn)
+{
+    std::atomic<std::size_t> next(0);
+    auto worker = [&]() {
+        for(std::size_t i = next++; i < n; i = next++) fn(i);
+    };
+
+    std::vector<std::thread> pool;
+    for(unsigned int t = 1; t < std::min<std::size_t>(threads, n); ++t)
+        pool.emplace_back(worker);
+    worker();
+    for(auto& thread : pool) thread.join();
+}
+
+} // namespace
+
+ParallelScanner::ParallelScanner(std::string_view source, unsigned int threads, unsigned int chunkSize)
+    : source(source), endLine(1), chunk(0), index(0), error(0)
+{
+    if(threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+    split(threads, chunkSize);
+
+    /* the first line of each chunk is one more than the newlines before it */
+    parallelFor(chunks.size(), threads, [this](std::size_t i) {
+        chunks[i].firstLine = std::count(this->source.begin() + chunks[i].begin,
+                                         this->source.begin() + chunks[i].limit, '\n');
+    });
+    unsigned int line = 1;
+    for(auto& c : chunks)
+    {
+        unsigned int newlines = c.firstLine;
+        c.firstLine = line;
+        line += newlines;
+    }
+
+    /* lex every chunk speculatively, assuming it starts between lexemes */
+    parallelFor(chunks.size(), threads, [this](std::size_t i) {
+        lex(chunks[i], chunks[i].begin, chunks[i].firstLine);
+    });
+
+    stitch();
+    intern(threads);
+}
+
+void ParallelScanner::split(unsigned int threads, unsigned int chunkSize)
+{
+    unsigned int length = source.length();
+    unsigned int size = chunkSize;
+    if(size == 0) size = std::max(MIN_CHUNK, length / (threads * CHUNKS_PER_THREAD) + 1);
+
+    unsigned int begin = 0;
+    while(begin < length)
+    {
+        unsigned int limit = length;
+        if(length - begin > size)
+        {
+            /*
+            ** Cut at the start of a line that doesn't start with whitespace,
+            ** so a run of blanks or indentation never straddles the cut; any
+            ** line start will do if there isn't one close by.
+            */
+            std::size_t nl = source.find('\n', begin + size);
+            std::size_t cut = nl;
+            while(cut != std::string_view::npos && cut + 1 < length && cut < nl + size / 8
+                    && (source[cut + 1] == ' ' || source[cut + 1] == '\t'
+                        || source[cut + 1] == '\r' || source[cut + 1] == '\n'))
+                cut = source.find('\n', cut + 1);
+            if(cut == std::string_view::npos || cut >= nl + size / 8) cut = nl;
+            if(cut != std::string_view::npos) limit = cut + 1;
+        }
+        Chunk c;
+        c.begin = begin;
+        c.limit = limit;
+        chunks.push_back(std::move(c));
+        begin = limit;
+    }
+}
+
+void ParallelScanner::lex(Chunk& chunk, unsigned int from, unsigned int line)
+{
+    Scanner scanner(source, from, chunk.limit, line);
+    scanner.deferErrors();
+    scanner.deferInterning();
+
+    std::unordered_map<std::string_view, Symbol> local;
+    chunk.names.clear();
+
+    /* a guess at one token per 8 bytes saves most of the regrowing */
+    chunk.tokens.clear();
+    chunk.tokens.reserve((chunk.limit - from) / 8);
+    chunk.errors.clear();
+    std::size_t errors = 0;
+    for(Token t = scanner.nextToken();; t = scanner.nextToken())
+    {
+        for(; errors < scanner.errors().size(); ++errors)
+            chunk.errors.emplace_back(chunk.tokens.size(), scanner.errors()[errors]);
+        if(t.type == END_OF_FILE) break;
+
+        if(t.type == IDENTIFIER || t.type == STRING)
+        {
+            std::string_view name = t.type == STRING ? t.stringValue() : t.lexeme;
+            auto it = local.emplace(name, chunk.names.size()).first;
+            if(it->second == chunk.names.size()) chunk.names.push_back(name);
+            t.symbol = it->second;
+        }
+        chunk.tokens.push_back(std::move(t));
+    }
+
+    chunk.end = scanner.position();
+    chunk.endLine = scanner.lineNumber();
+}
+
+void ParallelScanner::stitch()
+{
+    unsigned int end = 0;
+    for(auto& c : chunks)
+    {
+        if(end != c.begin)
+        {
+            /*
+            ** The previous chunk ended inside a string or comment that runs
+            ** into this one, so our speculative tokens are wrong. Lex again
+            ** from where it really stopped; if that's past our limit too, the
+            ** whole chunk was inside that lexeme and we're left empty.
+            */
+            if(end >= c.limit)
+            {
+                c.tokens.clear();
+                c.errors.clear();
+                continue;
+            }
+            lex(c, end, endLine);
+        }
+        end = c.end;
+        endLine = c.endLine;
+    }
+}
+
+void ParallelScanner::intern(unsigned int threads)
+{
+    std::vector<std::vector<Symbol>> symbols(chunks.size());
+    for(std::size_t i = 0; i < chunks.size(); ++i)
+    {
+        for(auto name : chunks[i].names) symbols[i].push_back(SymbolTable::intern(name));
+    }
+
+    parallelFor(chunks.size(), threads, [this, &symbols](std::size_t i) {
+        for(auto& t : chunks[i].tokens)
+        {
+            if(t.type == IDENTIFIER || t.type == STRING) t.symbol = symbols[i][t.symbol];
+        }
+    });
+}
+
+Token ParallelScanner::nextToken()
+{
+    while(chunk < chunks.size())
+    {
+        Chunk& c = chunks[chunk];
+        for(; error < c.errors.size() && c.errors[error].first <= index; ++error)
+            Lox::error(c.errors[error].second.line, c.errors[error].second.message);
+
+        /* each token is handed out once, and a chunk's memory goes once it's drained */
+        if(index < c.tokens.size()) return std::move(c.tokens[index++]);
+        std::vector<Token>().swap(c.tokens);
+        chunk++;
+        index = 0;
+        error = 0;
+    }
+
+    return Token(END_OF_FILE, "", 0, endLine);
+}
+
+std::vector<Token> ParallelScanner::scanTokens()
+{
+    std::vector<Token> tokens;
+    do {
+        tokens.push_back(nextToken());
+    } while(tokens.back().type != END_OF_FILE);
+
+    return tokens;
+}
+
+} // namespace lox
@@ -0,0 +1,75 @@
+#ifndef LOX_PARALLEL_SCANNER_H
+#define LOX_PARALLEL_SCANNER_H
+
+#include<string_view>
+#include<utility>
+#include<vector>
+
+#include"scanner.h"
+#include"token.h"
+
+namespace lox {
+
+/*
+** An opt-in scanner for very large files. The source is cut into chunks at
+** line starts, and every chunk is lexed on its own thread as if it began
+** outside any string or comment. The chunks are then stitched together in
+** order: if the previous chunk's last lexeme (a multi-line string or block
+** comment) ran past the boundary, the guess was wrong and that chunk is lexed
+** again from where the previous one really stopped.
+**
+** The tokens, their line numbers and the scan errors are exactly those the
+** sequential Scanner produces. Each error is kept with the index of the
+** token whose scanning ran into it, and reported as that token is handed
+** out, which is when the Scanner would have reported it.
+**
+** Since the SymbolTable is single-threaded, each chunk numbers its names in a
+** table of its own. Stitching interns those few names in chunk order, which
+** hands out the same Symbols a sequential scan would, and the tokens are then
+** renumbered in parallel.
+*/
+class ParallelScanner : public TokenSource {
+public:
+    /*
+    ** threads == 0 means one per hardware thread, and chunkSize == 0 sizes
+    ** the chunks to the file; anything else is what tests cut it into
+    */
+    ParallelScanner(std::string_view source, unsigned int threads = 0, unsigned int chunkSize = 0);
+    ParallelScanner(const ParallelScanner&) = delete;
+    ~ParallelScanner() = default;
+
+    Token nextToken() override;
+    std::vector<Token> scanTokens();
+
+private:
+    struct Chunk {
+        unsigned int begin;
+        unsigned int limit;
+        unsigned int firstLine;
+        /* where the chunk's scanner stopped, and on which line */
+        unsigned int end;
+        unsigned int endLine;
+        std::vector<Token> tokens;
+        /* each with the index in tokens of the token being scanned, or its size at the end */
+        std::vector<std::pair<std::size_t, Scanner::Error>> errors;
+        /* the chunk's own names, indexed by the Symbol its tokens carry */
+        std::vector<std::string_view> names;
+    };
+
+    void split(unsigned int threads, unsigned int chunkSize);
+    void lex(Chunk& chunk, unsigned int from, unsigned int line);
+    void stitch();
+    void intern(unsigned int threads);
+
+    std::string_view source;
+    std::vector<Chunk> chunks;
+    unsigned int endLine;
+    /* read position for nextToken(), and how many of the chunk's errors it has reported */
+    std::size_t chunk;
+    std::size_t index;
+    std::size_t error;
+};
+
+} // namespace lox
+
+#endif
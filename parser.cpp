@@ -1,9 +1,14 @@
+#include<array>
+
 #include "parser.h"
 
 namespace lox {
 
-Parser::Parser(const std::vector<Token> &tokens)
-    : current(0), tokens(tokens) {}
+Parser::Parser(TokenSource& source)
+    : source(source), current(0), program(new Program())
+{
+    window[0] = source.nextToken();
+}
 
 
 StmtPtr Parser::declaration()
@@ -11,6 +16,8 @@ StmtPtr Parser::declaration()
 
     try
     {
+        if(match({CLASS})) return classDeclaration();
+        if(match({FUN})) return function("function");
         if(match({VAR})) return varDeclaration();
 
         return statement();
@@ -33,7 +40,7 @@ StmtPtr Parser::declaration()
 StmtPtr Parser::varDeclaration() {
     Token name = consume(IDENTIFIER, "Expected variable name.");
 
-    ExprPtr initializer;
+    ExprPtr initializer = nullptr;
 
     if(match({EQUAL}))
     {   /* copy elision, aka move asgnt operator */
@@ -41,8 +48,46 @@ StmtPtr Parser::varDeclaration() {
     }
 
     consume(SEMI_COLON, "Expected ';' after variable declaration.");
-    return StmtPtr(new Var(name, std::move(initializer)));
+    return make<Var>(name, initializer);
+}
+StmtPtr Parser::classDeclaration() {
+    Token name = consume(IDENTIFIER, "Expected class name.");
+
+    Variable* superclass = nullptr;
+    if(match({LESS}))
+    {
+        consume(IDENTIFIER, "Expected superclass name.");
+        superclass = make<Variable>(previous());
+    }
+    consume(LEFT_BRACE, "Expected '{' before class body.");
+
+    std::vector<FunPtr> methods;
+    while(!check(RIGHT_BRACE) && !isAtEnd()) methods.push_back(function("method"));
+
+    consume(RIGHT_BRACE, "Expected '}' after class body.");
+    return make<Class>(name, superclass, program->arena.list(methods));
+}
+
+FunPtr Parser::function(const std::string& kind) {
+    Token name = consume(IDENTIFIER, "Expected " + kind + " name.");
+    consume(LEFT_PAREN, "Expected '(' after " + kind + " name.");
+
+    std::vector<Symbol> params;
+    if(!check(RIGHT_PAREN))
+    {
+        do {
+            /* reported, but not thrown: the parser isn't confused */
+            if(params.size() >= MAX_ARGS) Lox::error(peek(), "Can't have more than 255 parameters.");
+            params.push_back(consume(IDENTIFIER, "Expected parameter name.").symbol);
+        } while(match({COMMA}));
+    }
+    consume(RIGHT_PAREN, "Expected ')' after parameters.");
+
+    consume(LEFT_BRACE, "Expected '{' before " + kind + " body.");
+    ArenaList<StmtPtr> body = block();
+    return make<Function>(name, program->arena.list(params), body);
 }
+
 StmtPtr Parser::statement() {
     if(match({IF})) 
         return ifStatement();
@@ -52,12 +97,19 @@ StmtPtr Parser::statement() {
          return whileStatement();
     if(match({FOR}))
          return forStatement();
+    if(match({RETURN}))
+         return returnStatement();
+    if(match({BREAK, CONTINUE}))
+         return jumpStatement();
     if(match({LEFT_BRACE}))
-         return StmtPtr(new Block(block()));
+    {
+        unsigned int line = previous().line;
+        return make<Block>(block(), line);
+    }
     return expressionStatement();
 }
 
-std::vector<StmtPtr> Parser::block()
+ArenaList<StmtPtr> Parser::block()
 {
     std::vector<StmtPtr> statements;
 
@@ -67,20 +119,20 @@ std::vector<StmtPtr> Parser::block()
     }
 
     consume(RIGHT_BRACE, "Expected '}' after block.");
-    return statements;
+    return program->arena.list(statements);
 }
 
 StmtPtr Parser::expressionStatement() {
     ExprPtr expr = comma();
     consume(SEMI_COLON, "Expected ';' after expression.");
-    return StmtPtr(new Expression(std::move(expr)));
+    return make<Expression>(expr);
 }
 
 StmtPtr Parser::printStatement() {
     ExprPtr value = comma();
 
     consume(SEMI_COLON, "Expected ';' after value.");
-    return StmtPtr(new Print(std::move(value)));
+    return make<Print>(value);
 }
 
 StmtPtr Parser::ifStatement() {
@@ -89,15 +141,14 @@ StmtPtr Parser::ifStatement() {
     consume(RIGHT_PAREN, "Expected ')' after if condition.");
     StmtPtr thenBlock = statement();
 
-    StmtPtr elseBlock;
+    StmtPtr elseBlock = nullptr;
     /*
     ** In the case of nested if statements,
     ** the else clause belongs to the closest 'if' to it.
     */
     if(match({ELSE})) elseBlock = statement();
 
-    return StmtPtr(new If(std::move(condition), 
-            std::move(thenBlock), std::move(elseBlock)));
+    return make<If>(condition, thenBlock, elseBlock);
 
 }
 
@@ -106,12 +157,13 @@ StmtPtr Parser::whileStatement() {
     ExprPtr condition = comma();
     consume(RIGHT_PAREN, "Expected ')' after condition");
     /** call to statement returns the body of the while loop */
-    return StmtPtr(new While(std::move(condition), statement()));
+    return make<While>(condition, statement());
 }
 
 StmtPtr Parser::forStatement() {
+    unsigned int line = previous().line;
     consume(LEFT_PAREN, "Expected '(' after for");
-    StmtPtr initializer;
+    StmtPtr initializer = nullptr;
     /* first we parse the intializer*/
     if(match({SEMI_COLON})) initializer = nullptr;
     else if(match({VAR})) initializer = varDeclaration();
@@ -135,168 +187,208 @@ StmtPtr Parser::forStatement() {
 
 
 
-    if(increment != nullptr) {
-        std::vector<StmtPtr> v;
-        v.push_back(std::move(body));
-        v.push_back(StmtPtr(new Expression(std::move(increment))));
-        body.reset(new Block(std::move(v)));
-    }
-
     if(condition == nullptr) {
-        condition.reset(new Literal(true));
+        condition = make<Literal>(true);
     }
 
-    body.reset(new While(std::move(condition), std::move(body)));
+    /* the increment stays apart from the body, so that continue doesn't skip it */
+    body = make<While>(condition, body, increment);
 
 
     if(initializer != nullptr) {
         std::vector<StmtPtr> v;
-        v.push_back(std::move(initializer));
-        v.push_back(std::move(body)); /* a while loop*/
-        body.reset(new Block(std::move(v)));
+        v.push_back(initializer);
+        v.push_back(body); /* a while loop*/
+        body = make<Block>(program->arena.list(v), line);
     }
 
     return body;
 
 }
 
-ExprPtr Parser::comma()
-{
-    ExprPtr expr = expression();
-    while(match({COMMA}))
-    {
-        Token oper = previous();
-        ExprPtr right = expression();
-        expr = ExprPtr(new Binary(std::move(expr), oper, std::move(right)));
-    }
+StmtPtr Parser::returnStatement() {
+    Token keyword = previous();
+    ExprPtr value = nullptr;
+    if(!check(SEMI_COLON)) value = comma();
 
-    return expr;
+    consume(SEMI_COLON, "Expected ';' after return value.");
+    return make<Return>(keyword, value);
 }
 
-ExprPtr Parser::logicOr() {
-    ExprPtr expr = logicAnd();
+/* whether it is inside a loop is left to the Resolver */
+StmtPtr Parser::jumpStatement() {
+    Token keyword = previous();
+    consume(SEMI_COLON, "Expected ';' after '" + std::string(keyword.lexeme) + "'.");
+    if(keyword.type == BREAK) return make<Break>(keyword);
+    return make<Continue>(keyword);
+}
 
-    while(match({OR})) {
-        Token oper = previous();
-        ExprPtr right = logicAnd();
-        expr = ExprPtr(new Logical(std::move(expr), oper, std::move(right)));
-    }
+/*
+** Binary operators are parsed by precedence climbing over the table below
+** rather than with one function per grammar level. The trees that come out
+** are the same as the grammar in parser.h describes: every operator is left
+** associative except assignment, which is right associative and needs an
+** l-value on its left.
+*/
+namespace {
+
+struct InfixRule {
+    Precedence precedence;
+    /* 'and' and 'or' build Logical nodes, everything else Binary */
+    bool logical;
+};
+
+constexpr std::array<InfixRule, END_OF_FILE + 1> makeInfixRules()
+{
+    std::array<InfixRule, END_OF_FILE + 1> rules{};
+    rules[COMMA] = {PREC_COMMA, false};
+    rules[EQUAL] = {PREC_ASSIGNMENT, false};
+    rules[OR] = {PREC_OR, true};
+    rules[AND] = {PREC_AND, true};
+    rules[BANG_EQUAL] = rules[EQUAL_EQUAL] = {PREC_EQUALITY, false};
+    rules[GREATER] = rules[GREATER_EQUAL] = {PREC_COMPARISON, false};
+    rules[LESS] = rules[LESS_EQUAL] = {PREC_COMPARISON, false};
+    rules[MINUS] = rules[PLUS] = {PREC_TERM, false};
+    rules[SLASH] = rules[STAR] = {PREC_FACTOR, false};
+    return rules;
+}
 
-    return expr;
+constexpr std::array<InfixRule, END_OF_FILE + 1> infixRules = makeInfixRules();
+
+static_assert(infixRules[STAR].precedence > infixRules[PLUS].precedence, "bad precedence table");
+static_assert(infixRules[IDENTIFIER].precedence == PREC_NONE, "bad precedence table");
+
+} // namespace
+
+ExprPtr Parser::comma()
+{
+    return parsePrecedence(PREC_COMMA);
 }
-ExprPtr Parser::logicAnd() {
-    ExprPtr expr = equality();
 
-    while(match({AND})) {
-        Token oper = previous();
-        ExprPtr right = equality();
-        expr = ExprPtr(new Logical(std::move(expr), oper, std::move(right)));
-    }
-    return expr;
+ExprPtr Parser::expression() {
+    return parsePrecedence(PREC_ASSIGNMENT);
 }
 
-ExprPtr Parser::assignment() {
-    ExprPtr expr = logicOr();
+ExprPtr Parser::parsePrecedence(Precedence minimum)
+{
+    ExprPtr expr = unary();
 
-    if(match({EQUAL}))
+    for(;;)
     {
-        Token equals = previous();
-        /* We recursively call assignment to parse the RHS, because
-        ** it is right associative
-        */
-        ExprPtr value = assignment();
+        const InfixRule& rule = infixRules[peek().type];
+        if(rule.precedence == PREC_NONE || rule.precedence < minimum) break;
 
-        /* is expr an instance of Variable* ?*/
-        if(dynamic_cast<Variable*>(expr.get()) != nullptr)
+        Token oper = advance();
+        if(oper.type == EQUAL)
         {
-            return ExprPtr(new Assign(dynamic_cast<Variable*>(expr.get())->name, std::move(value)));
+            expr = assignment(expr, oper);
+            continue;
         }
 
-        Lox::error(equals, "Invalid assignment target.");
+        /* the right operand only takes operators that bind tighter */
+        ExprPtr right = parsePrecedence(static_cast<Precedence>(rule.precedence + 1));
+        if(rule.logical) expr = make<Logical>(expr, oper, right);
+        else expr = make<Binary>(expr, oper, right);
     }
 
     return expr;
 }
-ExprPtr Parser::expression() {
-    return assignment();
-}
 
-ExprPtr Parser::equality() {
-    ExprPtr expr = comparison();
-    while(match({BANG_EQUAL, EQUAL_EQUAL}))
+ExprPtr Parser::assignment(ExprPtr target, const Token& equals) {
+    /* We recursively parse the RHS at the same level, because
+    ** it is right associative
+    */
+    ExprPtr value = parsePrecedence(PREC_ASSIGNMENT);
+
+    /* is target an instance of Variable* ?*/
+    if(Variable* variable = dynamic_cast<Variable*>(target))
     {
-        Token oper = previous();
-        ExprPtr right = comparison();
-        expr = ExprPtr(new Binary(std::move(expr), oper, std::move(right)));
+        return make<Assign>(variable->name, value, variable->line);
     }
-    return expr;
-}
-
-ExprPtr Parser::comparison() {
-    ExprPtr expr = addition();
-    while(match({GREATER, GREATER_EQUAL, LESS, LESS_EQUAL}))
+    /* or a property, which the parser took for a Get */
+    if(Get* get = dynamic_cast<Get*>(target))
     {
-        Token oper = previous();
-        ExprPtr right = addition();
-        expr = ExprPtr(new Binary(std::move(expr), oper, std::move(right)));
+        return make<Set>(get->object, get->name, value, get->line);
     }
-    return expr;
+
+    Lox::error(equals, "Invalid assignment target.");
+    return target;
 }
 
-ExprPtr Parser::addition() {
-    ExprPtr expr = multiplication();
-    while(match({MINUS, PLUS}))
+ExprPtr Parser::unary() {
+    if(match({BANG, MINUS}))
     {
         Token oper = previous();
-        ExprPtr right = multiplication();
-        expr = ExprPtr(new Binary(std::move(expr), oper, std::move(right)));
+        ExprPtr right = parsePrecedence(PREC_UNARY);
+        return make<Unary>(oper, right);
     }
-    return expr;
-
+    return call();
 }
 
-ExprPtr Parser::multiplication() {
-    ExprPtr expr = unary();
-    while(match({SLASH, STAR}))
+ExprPtr Parser::call() {
+    ExprPtr expr = primary();
+    while(match({LEFT_PAREN, DOT}))
     {
-        Token oper = previous();
-        ExprPtr right = unary();
-        expr = ExprPtr(new Binary(std::move(expr), oper, std::move(right)));
+        if(previous().type == LEFT_PAREN) expr = finishCall(expr);
+        else
+        {
+            Token name = consume(IDENTIFIER, "Expected property name after '.'.");
+            expr = make<Get>(expr, name);
+        }
     }
     return expr;
-
 }
 
-ExprPtr Parser::unary() {
-    if(match({BANG, MINUS}))
+/* the arguments are separated by commas, so each one is an expression, not a comma */
+ExprPtr Parser::finishCall(ExprPtr callee) {
+    std::vector<ExprPtr> args;
+    if(!check(RIGHT_PAREN))
     {
-        Token oper = previous();
-        ExprPtr right = unary();
-        return ExprPtr(new Unary(oper, std::move(right)));
+        do {
+            if(args.size() >= MAX_ARGS) Lox::error(peek(), "Can't have more than 255 arguments.");
+            args.push_back(expression());
+        } while(match({COMMA}));
     }
-    return primary();
+    Token paren = consume(RIGHT_PAREN, "Expected ')' after arguments.");
+    return make<Call>(paren, callee, program->arena.list(args));
 }
 
 ExprPtr Parser::primary()
 {
-    if (match({FALSE})) return ExprPtr(new Literal(false));
-    if (match({TRUE})) return ExprPtr(new Literal(true));
-    if (match({NIL})) return ExprPtr(new Literal(nullptr));
+    if (match({FALSE})) return make<Literal>(false);
+    if (match({TRUE})) return make<Literal>(true);
+    if (match({NIL})) return make<Literal>(nullptr);
 
-    if (match({NUMBER, STRING})) {
-        return ExprPtr(new Literal(previous().literal));
+    if (match({NUMBER})) {
+        return make<Literal>(previous().number);
+    }
+    if (match({STRING})) {
+        Symbol symbol = previous().symbol;
+        auto it = strings.find(symbol);
+        if(it == strings.end())
+            it = strings.emplace(symbol, Value::string(SymbolTable::name(symbol))).first;
+        return make<Literal>(it->second);
     }
 
     if (match({LEFT_PAREN})) {
         ExprPtr expr = expression();
         consume(RIGHT_PAREN, "Expected ')' after expression.\n");
-        return ExprPtr(new Grouping(std::move(expr)));
+        return make<Grouping>(expr);
     }
 
-    if(match({VAR})) return ExprPtr(new Variable(previous()));
+    if(match({THIS})) return make<This>(previous());
+
+    if(match({SUPER})) {
+        Token keyword = previous();
+        consume(DOT, "Expected '.' after 'super'.");
+        Token method = consume(IDENTIFIER, "Expected superclass method name.");
+        return make<Super>(keyword, method);
+    }
+
+    if(match({VAR})) return make<Variable>(previous());
 
 
-    if(match({IDENTIFIER})) return ExprPtr(new Variable(previous()));
+    if(match({IDENTIFIER})) return make<Variable>(previous());
 
 
     /* if none of the above cases is matched, we're on a token that
@@ -310,18 +402,11 @@ Token Parser::consume(TokenType type, const std::string& message) {
     throw ParseError::error(peek(), message);
 }
 
-bool Parser::match(const std::vector<TokenType>& types)
+bool Parser::match(TokenSet types)
 {
-    for(TokenType t: types)
-    {
-
-        if(check(t))
-        {
-            advance();
-            return true;
-        }
-    }
-    return false;
+    if(isAtEnd() || !types.contains(peek().type)) return false;
+    advance();
+    return true;
 }
 
 void Parser::synchronize()
@@ -352,15 +437,14 @@ void Parser::synchronize()
     }
 }
 
-std::vector<StmtPtr> Parser::parse()
+std::unique_ptr<Program> Parser::parse()
 {
-    std::vector<StmtPtr> declarations;
     while(!isAtEnd())
     {
-        declarations.push_back(declaration());
+        program->statements.push_back(declaration());
     }
 
-    return declarations;
+    return std::move(program);
 
 }
 } // namespace lox
\ No newline at end of file
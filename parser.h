@@ -3,6 +3,7 @@
 
 #include<exception>
 #include<memory>
+#include<unordered_map>
 #include<vector>
 
 #include"expr.h"
@@ -17,9 +18,17 @@
 ** The grammar for lox is defined as follows:
 ** -------------------------------------------------------------
 ** program        --> declaration* EOF;
-** declaration    --> varDecl | statement;
+** declaration    --> classDecl | funDecl | varDecl | statement;
+** classDecl      --> "class" IDENTIFIER ( "<" IDENTIFIER )? "{" function* "}" ;
+** funDecl        --> "fun" function ;
+** function       --> IDENTIFIER "(" parameters? ")" block ;
+** parameters     --> IDENTIFIER ( "," IDENTIFIER )* ;
 ** varDecl        --> "var" IDENTIFIER ("=" expression)? ";" ;
-** statement      --> exprStmt | printStmt | ifStmt | whileStmt | forStmt | block;
+** statement      --> exprStmt | printStmt | ifStmt | whileStmt | forStmt
+**                  | returnStmt | breakStmt | continueStmt | block;
+** returnStmt     --> "return" comma? ";" ;
+** breakStmt      --> "break" ";" ;
+** continueStmt   --> "continue" ";" ;
 ** ifStmt         --> "if" "(" expression ")" ("else" statement)?;
 ** whileStmt      --> "while" "(" expression ")" statment ;
 ** forStmt        --> "for" "(" varDecl | exprStmt | ";" expression? ";" expression? ")" statement
@@ -28,7 +37,7 @@
 ** printStmt      --> "print" comma ";" ;
 ** comma          --> expression ((",") expression)*
 ** expression     --> assignment;
-** assignment     -->  IDENTIFIER "=" assignment | logic_or ;
+** assignment     -->  ( call "." )? IDENTIFIER "=" assignment | logic_or ;
 ** logic_or       -->  logic_and ("or" logic_and)*;
 ** logic_and      -->  equality ("and" equality)*;
 ** equality       --> comparison ( ( "!=" | "==" ) comparison )* ;
@@ -36,42 +45,68 @@
 ** addition       --> multiplication ( ( "-" | "+" ) multiplication )* ;
 ** multiplication --> unary ( ( "/" | "*" ) unary )* ;
 ** unary          -->  ( "!" | "-" ) unary
-**                 | primary ;
-** primary        --> NUMBER | STRING | "false" | "true" | "nil"
-**                   | "(" expression ")" | IDENTIFIER | "break" | "continue";
+**                 | call ;
+** call           --> primary ( "(" arguments? ")" | "." IDENTIFIER )* ;
+** arguments      --> expression ( "," expression )* ;
+** primary        --> NUMBER | STRING | "false" | "true" | "nil" | "this"
+**                   | "(" expression ")" | IDENTIFIER | "super" "." IDENTIFIER ;
+**
+** Everything from comma down to multiplication is parsed by precedence
+** climbing (parsePrecedence) over a constexpr operator table in parser.cpp,
+** rather than by one function per level.
 */
 
 namespace lox {
 
+/* binding power of the binary operators, loosest first */
+enum Precedence {
+    PREC_NONE,
+    PREC_COMMA,       /* , */
+    PREC_ASSIGNMENT,  /* = */
+    PREC_OR,          /* or */
+    PREC_AND,         /* and */
+    PREC_EQUALITY,    /* == != */
+    PREC_COMPARISON,  /* < > <= >= */
+    PREC_TERM,        /* + - */
+    PREC_FACTOR,      /* * / */
+    PREC_UNARY        /* ! - */
+};
 
+/*
+** The parser pulls tokens from its TokenSource as it goes and only keeps a
+** small ring buffer of them: the token being looked at and the one just
+** consumed, which is all the lookahead the grammar needs.
+*/
 class Parser {
 public:
-    Parser(const std::vector<Token> &tokens);
+    /* the most parameters a function, or arguments a call, can have */
+    static constexpr std::size_t MAX_ARGS = 255;
+
+    Parser(TokenSource& source);
 
     StmtPtr declaration();
+    StmtPtr classDeclaration();
     StmtPtr varDeclaration();
     FunPtr function(const std::string &kind);
     StmtPtr statement();
-    std::vector<StmtPtr> block();
+    ArenaList<StmtPtr> block();
     StmtPtr expressionStatement();
     StmtPtr printStatement();
     StmtPtr ifStatement();
     StmtPtr whileStatement();
     StmtPtr forStatement();
+    StmtPtr returnStatement();
+    StmtPtr jumpStatement();
     ExprPtr comma();
     ExprPtr expression();
-    ExprPtr assignment();
-    ExprPtr logicOr();
-    ExprPtr logicAnd();
-    ExprPtr equality();
-    ExprPtr comparison();
-    ExprPtr addition();
-    ExprPtr multiplication();
+    ExprPtr parsePrecedence(Precedence minimum);
+    ExprPtr assignment(ExprPtr target, const Token& equals);
     ExprPtr unary();
+    ExprPtr call();
     ExprPtr primary();
     ExprPtr finishCall(ExprPtr callee);
     Token consume(TokenType type, const std::string& message);
-    bool match(const std::vector<TokenType>& types);
+    bool match(TokenSet types);
 
     bool check(const TokenType& type) {
         if(isAtEnd()) return false;
@@ -81,24 +116,41 @@ public:
         return peek().type == END_OF_FILE;
     }
 
+    /* references returned here are only good until the next advance() */
     Token& advance() {
-        if(!isAtEnd()) current++;
+        if(!isAtEnd()) {
+            current++;
+            window[current % WINDOW] = source.nextToken();
+        }
         return previous();
     }
     Token& peek() {
-        return tokens[current];
+        return window[current % WINDOW];
     }
     Token& previous() {
-        return tokens[current - 1];
+        return window[(current - 1) % WINDOW];
     }
 
     void synchronize();
-    /*return unique_ptr's to be owned by caller (aka Lox::run())*/
-    std::vector<StmtPtr> parse();
+    /* the Program, and with it every node, is owned by the caller (aka Lox::run()) */
+    std::unique_ptr<Program> parse();
+
+    /* every node is allocated in the Program's Arena */
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        return program->arena.make<T>(std::forward<Args>(args)...);
+    }
 
 private:
+    static constexpr unsigned int WINDOW = 2;
+
+    TokenSource& source;
+    /* number of tokens consumed so far */
     unsigned int current;
-    std::vector<Token> tokens;
+    Token window[WINDOW];
+    std::unique_ptr<Program> program;
+    /* string literals with the same text share one string */
+    std::unordered_map<Symbol, Value> strings;
 
 };
 
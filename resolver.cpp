@@ -0,0 +1,379 @@
+#include"lox.h"
+#include"resolver.h"
+
+namespace lox {
+
+void Resolver::resolve(std::vector<StmtPtr>& statements)
+{
+    for(StmtPtr stmt : statements) resolve(stmt);
+}
+
+void Resolver::resolve(ExprPtr expr)
+{
+    if(expr != nullptr) expr->accept(*this);
+}
+
+void Resolver::resolve(StmtPtr stmt)
+{
+    if(stmt != nullptr) stmt->accept(*this);
+}
+
+void Resolver::resolve(ArenaList<StmtPtr> statements)
+{
+    for(StmtPtr stmt : statements) resolve(stmt);
+}
+
+void Resolver::beginScope()
+{
+    scopes.emplace_back();
+}
+
+/*
+** Every function a use of one of these variables is in is declared in this
+** scope or a nested one. Those from nested scopes have been decided already,
+** and a function here can only be called from the ones declared after it,
+** so going backwards decides each function before what it captures.
+*/
+unsigned int Resolver::endScope()
+{
+    Scope& scope = scopes.back();
+    for(std::size_t i = scope.locals.size(); i-- > 0;)
+    {
+        Local& local = scope.locals[i];
+        if(local.assigned && !local.callees.empty()) captureCallee(local, i);
+        if(local.function != nullptr)
+        {
+            bool escapes = local.escapes;
+            for(const Function* f : local.crossed)
+            {
+                if(f != local.function && escaping.count(f) != 0) escapes = true;
+            }
+            if(escapes) escaping.insert(local.function);
+        }
+
+        bool boxed = false;
+        for(const Function* f : local.crossed) boxed = boxed || escaping.count(f) != 0;
+        if(!boxed) continue;
+
+        if(local.boxed != nullptr) *local.boxed = true;
+        for(unsigned int* depth : local.uses) *depth += BOXED;
+        for(auto& [function, index] : local.captures) function->captures[index].boxed = true;
+    }
+
+    unsigned int slots = scope.locals.size();
+    scopes.pop_back();
+    return slots;
+}
+
+Resolver::Local* Resolver::declare(Symbol name, unsigned int line, bool* boxed)
+{
+    /* globals may be declared again, see Globals::define */
+    if(scopes.empty()) return nullptr;
+
+    Scope& scope = scopes.back();
+    if(!scope.slots.try_emplace(name, scope.locals.size()).second)
+    {
+        Lox::error(line, "Already a variable with this name in this scope.");
+        return nullptr;
+    }
+    scope.locals.push_back(Local{boxed});
+    return &scope.locals.back();
+}
+
+void Resolver::resolveLocal(Symbol name, bool escapes, unsigned int& depth, unsigned int& slot,
+                            bool assigns)
+{
+    for(std::size_t i = scopes.size(); i-- > 0;)
+    {
+        auto it = scopes[i].slots.find(name);
+        if(it == scopes[i].slots.end()) continue;
+
+        Local& local = scopes[i].locals[it->second];
+        if(escapes) local.escapes = true;
+        if(assigns) local.assigned = true;
+        if(i >= functionScope)
+        {
+            depth = scopes.size() - 1 - i;
+            slot = it->second;
+            local.uses.push_back(&depth);
+        }
+        else if(local.function == closures.back().function && !assigns && !local.assigned)
+        {
+            depth = CALLEE;
+            local.callees.emplace_back(&depth, &slot);
+        }
+        else
+        {
+            depth = UPVALUE;
+            slot = capture(closures.size() - 1, i, it->second);
+        }
+        return;
+    }
+    depth = GLOBAL;
+}
+
+/*
+** The function has been resolved by now, so its captures are copied to
+** the Arena again with this one at the end. It is made as capture() would
+** from the scope just outside the function, which is where the name is.
+*/
+void Resolver::captureCallee(Local& local, unsigned int slot)
+{
+    Function* function = local.function;
+    std::vector<Capture> captures(function->captures.begin(), function->captures.end());
+    unsigned int index = captures.size();
+    captures.push_back(Capture{true, false, 0, slot});
+    function->captures = arena.list(captures);
+
+    local.crossed.push_back(function);
+    local.captures.emplace_back(function, index);
+    for(auto [depth, use] : local.callees)
+    {
+        *depth = UPVALUE;
+        *use = index;
+    }
+    local.callees.clear();
+}
+
+unsigned int Resolver::capture(std::size_t closure, std::size_t scope, unsigned int slot)
+{
+    Closure& c = closures[closure];
+    auto [it, added] = c.indices.try_emplace(std::make_pair(scope, slot), c.captures.size());
+    if(!added) return it->second;
+
+    Local& local = scopes[scope].locals[slot];
+    local.crossed.push_back(c.function);
+    /* a closure is created in the scope just outside its own */
+    if(closure == 0 || closures[closure - 1].scope <= scope)
+    {
+        local.captures.emplace_back(c.function, it->second);
+        unsigned int depth = c.scope - 1 - scope;
+        c.captures.push_back(Capture{true, false, depth, slot});
+    }
+    else
+    {
+        unsigned int outer = capture(closure - 1, scope, slot);
+        c.captures.push_back(Capture{false, false, 0, outer});
+    }
+    return it->second;
+}
+
+/* a method's this is boxed like a parameter, if a closure that escapes uses it */
+void Resolver::function(Function& stmt, FunctionKind functionKind)
+{
+    std::size_t enclosingScope = functionScope;
+    FunctionKind enclosingKind = kind;
+    unsigned int enclosingLoops = loops;
+    functionScope = scopes.size();
+    kind = functionKind;
+    loops = 0;
+    closures.push_back(Closure{&stmt, scopes.size(), {}, {}});
+
+    beginScope();
+    std::size_t params = stmt.params.size() + (kind != FunctionKind::FUNCTION ? 1 : 0);
+    std::unique_ptr<bool[]> boxed(new bool[params]());
+    for(std::size_t i = 0; i < stmt.params.size(); ++i) declare(stmt.params[i], stmt.line, &boxed[i]);
+    if(params > stmt.params.size()) declare(thisName, stmt.line, &boxed[stmt.params.size()]);
+    resolve(stmt.body);
+    stmt.slots = endScope();
+
+    std::vector<unsigned int> boxedParams;
+    for(std::size_t i = 0; i < params; ++i)
+    {
+        if(boxed[i]) boxedParams.push_back(i);
+    }
+    stmt.boxedParams = arena.list(boxedParams);
+    stmt.captures = arena.list(closures.back().captures);
+    closures.pop_back();
+
+    functionScope = enclosingScope;
+    kind = enclosingKind;
+    loops = enclosingLoops;
+}
+
+Value Resolver::visitAssignExpr(Assign& expr)
+{
+    resolve(expr.value);
+    resolveLocal(expr.name, false, expr.depth, expr.slot, true);
+    return nullptr;
+}
+
+Value Resolver::visitBinaryExpr(Binary& expr)
+{
+    resolve(expr.left);
+    resolve(expr.right);
+    return nullptr;
+}
+
+/* calling a local function doesn't let it escape */
+Value Resolver::visitCallExpr(Call& expr)
+{
+    if(Variable* callee = dynamic_cast<Variable*>(expr.callee))
+        resolveLocal(callee->name, false, callee->depth, callee->slot);
+    else resolve(expr.callee);
+    expr.invoke = dynamic_cast<Get*>(expr.callee) != nullptr || dynamic_cast<Super*>(expr.callee) != nullptr;
+    for(ExprPtr arg : expr.args) resolve(arg);
+    return nullptr;
+}
+
+Value Resolver::visitGetExpr(Get& expr)
+{
+    resolve(expr.object);
+    return nullptr;
+}
+
+Value Resolver::visitGroupingExpr(Grouping& expr)
+{
+    resolve(expr.expr);
+    return nullptr;
+}
+
+Value Resolver::visitLiteralExpr(Literal& expr)
+{
+    return nullptr;
+}
+
+Value Resolver::visitLogicalExpr(Logical& expr)
+{
+    resolve(expr.left);
+    resolve(expr.right);
+    return nullptr;
+}
+
+Value Resolver::visitSetExpr(Set& expr)
+{
+    resolve(expr.object);
+    resolve(expr.value);
+    return nullptr;
+}
+
+Value Resolver::visitSuperExpr(Super& expr)
+{
+    if(classKind == ClassKind::NONE)
+    {
+        Lox::error(expr.line, "Can't use 'super' outside of a class.");
+        return nullptr;
+    }
+    if(classKind == ClassKind::CLASS)
+    {
+        Lox::error(expr.line, "Can't use 'super' in a class with no superclass.");
+        return nullptr;
+    }
+    resolveLocal(superName, false, expr.depth, expr.slot);
+    resolveLocal(thisName, false, expr.thisDepth, expr.thisSlot);
+    return nullptr;
+}
+
+Value Resolver::visitThisExpr(This& expr)
+{
+    if(classKind == ClassKind::NONE)
+    {
+        Lox::error(expr.line, "Can't use 'this' outside of a class.");
+        return nullptr;
+    }
+    resolveLocal(thisName, false, expr.depth, expr.slot);
+    return nullptr;
+}
+
+Value Resolver::visitUnaryExpr(Unary& expr)
+{
+    resolve(expr.right);
+    return nullptr;
+}
+
+Value Resolver::visitVariableExpr(Variable& expr)
+{
+    resolveLocal(expr.name, true, expr.depth, expr.slot);
+    return nullptr;
+}
+
+void Resolver::visitBlockStmt(Block& stmt)
+{
+    beginScope();
+    resolve(stmt.statements);
+    stmt.slots = endScope();
+}
+
+void Resolver::visitBreakStmt(Break& stmt)
+{
+    if(loops == 0) Lox::error(stmt.line, "Can't use 'break' outside of a loop.");
+}
+
+/* super is only ever used by the methods, which escape, so it is always boxed */
+void Resolver::visitClassStmt(Class& stmt)
+{
+    declare(stmt.name, stmt.line, &stmt.boxed);
+    ClassKind enclosingKind = classKind;
+    classKind = ClassKind::CLASS;
+    if(stmt.superclass != nullptr)
+    {
+        if(stmt.superclass->name == stmt.name) Lox::error(stmt.superclass->line, "A class can't inherit from itself.");
+        resolve(stmt.superclass);
+        classKind = ClassKind::SUBCLASS;
+        beginScope();
+        declare(superName, stmt.line, nullptr);
+    }
+
+    for(FunPtr method : stmt.methods)
+    {
+        escaping.insert(method);
+        function(*method, method->name == initName ? FunctionKind::INITIALIZER : FunctionKind::METHOD);
+    }
+
+    if(stmt.superclass != nullptr) endScope();
+    classKind = enclosingKind;
+}
+
+void Resolver::visitContinueStmt(Continue& stmt)
+{
+    if(loops == 0) Lox::error(stmt.line, "Can't use 'continue' outside of a loop.");
+}
+
+void Resolver::visitExpressionStmt(Expression& stmt)
+{
+    resolve(stmt.expression);
+}
+
+void Resolver::visitFunctionStmt(Function& stmt)
+{
+    if(Local* local = declare(stmt.name, stmt.line, &stmt.boxed)) local->function = &stmt;
+    function(stmt, FunctionKind::FUNCTION);
+}
+
+void Resolver::visitIfStmt(If& stmt)
+{
+    resolve(stmt.condition);
+    resolve(stmt.thenBranch);
+    resolve(stmt.elseBranch);
+}
+
+void Resolver::visitPrintStmt(Print& stmt)
+{
+    resolve(stmt.expression);
+}
+
+void Resolver::visitReturnStmt(Return& stmt)
+{
+    if(kind == FunctionKind::NONE) Lox::error(stmt.line, "Can't return from top-level code.");
+    if(kind == FunctionKind::INITIALIZER && stmt.value != nullptr)
+        Lox::error(stmt.line, "Can't return a value from an initializer.");
+    resolve(stmt.value);
+}
+
+/* the initializer is resolved first, so it can't see the variable itself */
+void Resolver::visitVarStmt(Var& stmt)
+{
+    resolve(stmt.initializer);
+    declare(stmt.name, stmt.line, &stmt.boxed);
+}
+
+void Resolver::visitWhileStmt(While& stmt)
+{
+    resolve(stmt.condition);
+    ++loops;
+    resolve(stmt.body);
+    --loops;
+    resolve(stmt.increment);
+}
+
+} // namespace lox
@@ -0,0 +1,173 @@
+#ifndef LOX_RESOLVER_H
+#define LOX_RESOLVER_H
+
+#include<map>
+#include<memory>
+#include<unordered_map>
+#include<unordered_set>
+#include<utility>
+#include<vector>
+
+#include"arena.h"
+#include"expr.h"
+#include"stmt.h"
+#include"symbol.h"
+
+namespace lox {
+
+/*
+** Works out, before a Program runs, which declaration every variable use
+** refers to. Local variables are numbered per scope in declaration order,
+** and each Variable and Assign that refers to one is given how many scopes
+** out it is and its number there, so the Interpreter can reach it without
+** looking up its name (see Environment). Names not declared in any
+** enclosing local scope are left as GLOBAL and looked up at run time.
+**
+** A use is resolved to the declarations that come before it, which is what
+** scoping at run time amounts to: `{ print a; var a = 1; }` reads an outer a.
+**
+** A function's parameters and the variables at the top of its body share
+** one scope, whose size the Function is given for its frame. A use of a
+** local of an enclosing function makes the function a closure: it becomes
+** UPVALUE, numbering one of the Function's captures, and every function in
+** between captures the variable too, so each closure can take it from the
+** one around it when it is created.
+**
+** Where a captured variable lives is decided by escape analysis once its
+** scope has been resolved. A local function escapes when its name is used
+** for anything but being called, e.g. returned, assigned or passed as an
+** argument, or is called from inside a function that escapes. Otherwise it
+** only runs while the scopes it captures from are live, and can keep
+** pointers to their slots. A variable captured through any function that
+** escapes is boxed instead: it lives in a Cell that the closures share, and
+** its uses in its own function get BOXED added to their depth.
+**
+** A local function's uses of its own name, straight from its body, are the
+** function that is running, unless the name is assigned to somewhere in
+** its scope. They get CALLEE and capture nothing, so a recursive function
+** doesn't keep itself alive through a Cell of its own. If the name is
+** assigned, they are made a capture like any other when the scope ends.
+**
+** A method is resolved like any other function, with one more local after
+** its parameters: this, which the call defines as the receiver. Methods are
+** called through instances, which can go anywhere, so they always escape.
+** A subclass's methods are declared in a scope of their own holding super,
+** the superclass, which they capture like any other variable.
+**
+** It also reports a return outside any function, or with a value in an
+** initializer, this or super outside any class, super in a class with no
+** superclass, a class inheriting from itself, and a break or continue
+** outside any loop of the function it is in.
+*/
+class Resolver : public ExprVisitor, public StmtVisitor {
+public:
+    /* what the Resolver works out is kept in the Program's Arena */
+    explicit Resolver(Arena& arena):
+        arena(arena), thisName(SymbolTable::intern("this")), superName(SymbolTable::intern("super")),
+        initName(SymbolTable::intern("init")) {}
+    Resolver(const Resolver&) = delete;
+
+    void resolve(std::vector<StmtPtr>& statements);
+
+    Value visitAssignExpr(Assign& expr) override;
+    Value visitBinaryExpr(Binary& expr) override;
+    Value visitCallExpr(Call& expr) override;
+    Value visitGetExpr(Get& expr) override;
+    Value visitGroupingExpr(Grouping& expr) override;
+    Value visitLiteralExpr(Literal& expr) override;
+    Value visitLogicalExpr(Logical& expr) override;
+    Value visitSetExpr(Set& expr) override;
+    Value visitSuperExpr(Super& expr) override;
+    Value visitThisExpr(This& expr) override;
+    Value visitUnaryExpr(Unary& expr) override;
+    Value visitVariableExpr(Variable& expr) override;
+
+    void visitBlockStmt(Block& stmt) override;
+    void visitBreakStmt(Break& stmt) override;
+    void visitClassStmt(Class& stmt) override;
+    void visitContinueStmt(Continue& stmt) override;
+    void visitExpressionStmt(Expression& stmt) override;
+    void visitFunctionStmt(Function& stmt) override;
+    void visitIfStmt(If& stmt) override;
+    void visitPrintStmt(Print& stmt) override;
+    void visitReturnStmt(Return& stmt) override;
+    void visitVarStmt(Var& stmt) override;
+    void visitWhileStmt(While& stmt) override;
+
+private:
+    enum class FunctionKind { NONE, FUNCTION, METHOD, INITIALIZER };
+    enum class ClassKind { NONE, CLASS, SUBCLASS };
+
+    /* a variable of an open scope */
+    struct Local {
+        /* the declaration's flag, set if the variable is boxed, or nullptr */
+        bool* boxed;
+        /* the function it names, if that's what it was declared by */
+        Function* function = nullptr;
+        /* whether it is used other than as the callee of a call, or assigned to */
+        bool escapes = false;
+        bool assigned = false;
+        /* the depths of its uses in its own function */
+        std::vector<unsigned int*> uses;
+        /* every function a use from a closure is in, below its own function */
+        std::vector<Function*> crossed;
+        /* the captures that take it straight from its slot */
+        std::vector<std::pair<Function*, unsigned int>> captures;
+        /* the (depth, slot) of the uses given CALLEE, in the function it names */
+        std::vector<std::pair<unsigned int*, unsigned int*>> callees;
+    };
+    struct Scope {
+        std::unordered_map<Symbol, unsigned int> slots;
+        /* by slot */
+        std::vector<Local> locals;
+    };
+    /* a function being resolved */
+    struct Closure {
+        Function* function;
+        /* the index in scopes of its own scope */
+        std::size_t scope;
+        std::vector<Capture> captures;
+        /* the index in captures of each variable it captures, by (scope, slot) */
+        std::map<std::pair<std::size_t, unsigned int>, unsigned int> indices;
+    };
+
+    void resolve(ExprPtr expr);
+    void resolve(StmtPtr stmt);
+    void resolve(ArenaList<StmtPtr> statements);
+    void function(Function& stmt, FunctionKind kind);
+
+    void beginScope();
+    /* decides which of the scope's variables are boxed; returns how many it declared */
+    unsigned int endScope();
+    /* boxed is where to record if the variable is boxed, see Local */
+    Local* declare(Symbol name, unsigned int line, bool* boxed);
+    /* escapes is false for a use that can't let the value out, e.g. as a callee */
+    void resolveLocal(Symbol name, bool escapes, unsigned int& depth, unsigned int& slot,
+                      bool assigns = false);
+    /* turns the CALLEE uses of the local at slot of the innermost scope into a capture */
+    void captureCallee(Local& local, unsigned int slot);
+    /* the index of the capture of the variable at (scope, slot) by closures[closure] */
+    unsigned int capture(std::size_t closure, std::size_t scope, unsigned int slot);
+
+    Arena& arena;
+    const Symbol thisName;
+    const Symbol superName;
+    const Symbol initName;
+    std::vector<Scope> scopes;
+    /* the functions being resolved, innermost last */
+    std::vector<Closure> closures;
+    /* the local functions found to escape so far */
+    std::unordered_set<const Function*> escaping;
+    /* the first of scopes that belongs to the function being resolved */
+    std::size_t functionScope = 0;
+    /* what the function being resolved is, NONE at the top level */
+    FunctionKind kind = FunctionKind::NONE;
+    /* what the innermost class declaration we're in is, NONE outside any */
+    ClassKind classKind = ClassKind::NONE;
+    /* how many loops of the function being resolved, or the top level, we're in */
+    unsigned int loops = 0;
+};
+
+} // namespace lox
+
+#endif
@@ -4,13 +4,11 @@
 #include<exception>
 #include<string>
 
-#include"token.h"
-
 namespace lox{
 
 class RuntimeError : public std::exception {
 public:
-    RuntimeError(const Token& token, const std::string& msg):token(token), msg(msg) {}
+    RuntimeError(unsigned int line, const std::string& msg):line(line), msg(msg) {}
     const char* what() const noexcept override
     {
         return "Runtime error";
@@ -21,7 +19,7 @@ public:
     friend class Lox;
     friend class Environment;
 private:
-    Token token;
+    unsigned int line;
     std::string msg;
 };
 
@@ -1,29 +1,65 @@
+#include<charconv>
+
 #include"scanner.h"
 #include"lox.h"
+#include"simdscan.h"
 
 namespace lox
 {
 
-Scanner::Scanner(const std::string& source): source(source),  start(0), current(0), line(1)
+Scanner::Scanner(std::string_view source)
+    : source(source), hasToken(false), start(0), current(0), limit(source.length()), line(1),
+      deferring(false), interning(true)
 {
 
 }
 
-void Scanner::addToken(TokenType type, Object literal)
+Scanner::Scanner(std::string_view source, unsigned int begin, unsigned int limit, unsigned int line)
+    : source(source), hasToken(false), start(begin), current(begin), limit(limit), line(line),
+      deferring(false), interning(true)
 {
-    std::string text(&source[start], &source[current]);
-    tokens.push_back(Token(type, text, literal, line));
+
 }
 
-std::vector<Token> Scanner::scanTokens()
+void Scanner::error(const std::string& message)
+{
+    if(deferring) deferred.push_back({line, message});
+    else Lox::error(line, message);
+}
+
+void Scanner::addToken(TokenType type, double number)
+{
+    token = Token(type, source.substr(start, current - start), number, line);
+    if(interning)
+    {
+        if(type == IDENTIFIER) token.symbol = SymbolTable::intern(token.lexeme);
+        else if(type == STRING) token.symbol = SymbolTable::intern(token.stringValue());
+    }
+    hasToken = true;
+}
+
+Token Scanner::nextToken()
 {
-  while(!isAtEnd())
+    while(current < limit)
     {
         start = current;
         scan();
+        if(hasToken)
+        {
+            hasToken = false;
+            return token;
+        }
     }
 
-    tokens.push_back(Token(END_OF_FILE, "", nullptr, line));
+    return Token(END_OF_FILE, "", 0, line);
+}
+
+std::vector<Token> Scanner::scanTokens()
+{
+    std::vector<Token> tokens;
+    do {
+        tokens.push_back(nextToken());
+    } while(tokens.back().type != END_OF_FILE);
 
     return tokens;
 }
@@ -39,52 +75,87 @@ bool Scanner::match(const char expected)
 
 void Scanner::matchString()
 {
-    while(peek() != '"' && !isAtEnd())
-    {
-        if(peek() == '\n') line++;
-        advance();
-    }
+    current = findStringEnd(at(current), end(), line) - source.data();
 
     if(isAtEnd())
     {
-        Lox::error(line, "Unterminated string.");
+        error("Unterminated string.");
         return;
     }
     /* consume closing "*/
     advance();
-    std::string value(&source[start + 1], &source[current - 1]);
-    addToken(STRING, value);
+    /* the value is recovered from the lexeme, see Token::stringValue() */
+    addToken(STRING);
 }
 
 void Scanner::matchNumber()
 {
-    while(isDigit(peek())) advance();
-    /* fractional part*/
-    if(peek() == '.' && isDigit(peekNext()))
+    /*
+    ** The digits are converted in place with std::from_chars, which isn't
+    ** locale-sensitive and doesn't need a temporary string. The fractional
+    ** and exponent parts are only consumed if digits follow, so '1.' and '1e'
+    ** still scan as a number followed by a '.' or an identifier.
+    */
+    std::chars_format format = std::chars_format::general;
+    unsigned int digits = start;
+
+    if(source[start] == '0' && (peek() == 'x' || peek() == 'X') && isHexDigit(peekNext()))
     {
         advance();
+        while(isHexDigit(peek())) advance();
+        format = std::chars_format::hex;
+        digits = start + 2;
+    }
+    else
+    {
         while(isDigit(peek())) advance();
+        /* fractional part*/
+        if(peek() == '.' && isDigit(peekNext()))
+        {
+            advance();
+            while(isDigit(peek())) advance();
+        }
+        /* exponent, with an optional sign */
+        if(peek() == 'e' || peek() == 'E')
+        {
+            unsigned int exponent = current + 1;
+            if(exponent < source.length() && (source[exponent] == '+' || source[exponent] == '-'))
+                exponent++;
+            if(exponent < source.length() && isDigit(source[exponent]))
+            {
+                current = exponent;
+                while(isDigit(peek())) advance();
+            }
+        }
     }
-    std::string num(&source[start], &source[current]);
-    addToken(NUMBER, std::stod(num));
+
+    double value = 0;
+    auto result = std::from_chars(at(digits), at(current), value, format);
+    /* still produce the token so the parser doesn't report a second error */
+    if(result.ec == std::errc::result_out_of_range)
+        error("Number literal is out of range.");
+    addToken(NUMBER, value);
 }
 
 void Scanner::matchIdentifier()
 {
-    while(isalnum(peek()) || peek() == '_') advance();
+    current = skipIdentifier(at(current), end()) - source.data();
 
     /*is it a keyword */
-    std::string text (&source[start], &source[current]);
-    TokenType t;
-    if(keywords.find(text) == keywords.end()) t = IDENTIFIER;
-    else t = keywords[text];
-
-    addToken(t);
+    addToken(keywordType(source.substr(start, current - start)));
 }
 
 void Scanner::consumeMultiLineComment()
 {
+    current = findCommentEnd(at(current), end(), line) - source.data();
 
+    if(isAtEnd())
+    {
+        error("Unterminated comment.");
+        return;
+    }
+    /* consume the closing star-slash */
+    current += 2;
 }
 void Scanner::scan()
 {
@@ -133,13 +204,12 @@ void Scanner::scan()
     case '>':
         addToken(match('=') ? GREATER_EQUAL: GREATER);
         break;
-    /*ignore white space*/
+    /*ignore white space, skipping whole runs of it at once*/
     case ' ':
     case '\r':
     case '\t':
-        break;
     case '\n':
-        line++;
+        current = skipWhitespace(at(start), end(), line) - source.data();
         break;
     case '"':
         matchString();
@@ -147,13 +217,12 @@ void Scanner::scan()
     case '/':
         if (match('/')) {
             // A comment goes until the end of the line.
-            while (peek() != '\n' && !isAtEnd()) advance();
+            current = findLineEnd(at(current), end()) - source.data();
+        }
+        else if(match('*'))
+        {
+            consumeMultiLineComment();
         }
-        /*TODO: Add support for multiline comments*/
-        /* else if(match('*'))
-           {
-               consumeMultiLineComment();
-           } */
         else {
             addToken(SLASH);
         }
@@ -169,7 +238,7 @@ void Scanner::scan()
         }
         else
         {
-            Lox::error(line, "Unexpected character.\n");
+            error("Unexpected character.\n");
         }
 
 
@@ -1,30 +1,67 @@
 #ifndef LOX_SCANNER_H
 #define LOX_SCANNER_H
 
-#include<map>
 #include<memory>
 #include<string>
+#include<string_view>
 #include<variant>
 #include<vector>
 
 #include"token.h"
 
 namespace lox {
-class Scanner {
+/*
+** The scanner works on a view of the source and never copies it: token
+** lexemes are slices of that view. Tokens are produced on demand through
+** nextToken(), so the parser only ever holds the few it is looking at;
+** scanTokens() is there for callers that want them all at once.
+*/
+class Scanner : public TokenSource {
 public:
-    Scanner(const std::string& source);
+    Scanner(std::string_view source);
+    /*
+    ** Scan only the lexemes that start in [begin, limit) of source, counting
+    ** lines from 'line'. The last lexeme may run past limit. Used by the
+    ** ParallelScanner to lex one chunk of a file.
+    */
+    Scanner(std::string_view source, unsigned int begin, unsigned int limit, unsigned int line);
     /*only one instance of the scanner should be alive*/
     Scanner(const Scanner&) = delete;
     ~Scanner() = default;
 
 
-
+    Token nextToken() override;
     std::vector<Token> scanTokens();
 
+    /* where scanning stopped, and the line it stopped on */
+    unsigned int position() const {
+        return current;
+    }
+    unsigned int lineNumber() const {
+        return line;
+    }
+
+    /* collect errors in errors() instead of reporting them straight away */
+    struct Error {
+        unsigned int line;
+        std::string message;
+    };
+    void deferErrors() {
+        deferring = true;
+    }
+    /* leave Token::symbol unset, for callers that intern tokens themselves */
+    void deferInterning() {
+        interning = false;
+    }
+    const std::vector<Error>& errors() const {
+        return deferred;
+    }
+    void error(const std::string& message);
+
     void addToken(TokenType type) {
-        addToken(type, nullptr);
+        addToken(type, 0);
     }
-    void addToken(TokenType type, Object literal);
+    void addToken(TokenType type, double number);
     void matchString();
     void matchNumber();
     void matchIdentifier();
@@ -48,43 +85,104 @@ public:
     bool isDigit(char c) {
         return c >= '0' && c <= '9';
     }
+    bool isHexDigit(char c) {
+        return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+    }
     bool match(const char expected);
     bool isAtEnd() {
         return current >= source.length();
     }
+    /* raw pointers for the bulk scanning routines in simdscan.h */
+    const char* at(unsigned int offset) {
+        return source.data() + offset;
+    }
+    const char* end() {
+        return source.data() + source.length();
+    }
 
 
 private:
-    std::string source;
-    std::vector<Token> tokens;
+    std::string_view source;
+    /* the token scan() produced, if any; whitespace and comments produce none */
+    Token token;
+    bool hasToken;
     unsigned int start;
     unsigned int current;
+    unsigned int limit;
     unsigned int line;
-    std::map<std::string, TokenType> keywords =
-    {
-        {"and",           AND},
-        {"break",       BREAK},
-        {"class",       CLASS},
-        {"continue", CONTINUE},
-        {"else",         ELSE},
-        {"false",       FALSE},
-        {"for",           FOR},
-        {"fun",           FUN},
-        {"if",             IF},
-        {"nil",           NIL},
-        {"or",             OR},
-        {"print",       PRINT},
-        {"return",     RETURN},
-        {"super",       SUPER},
-        {"this",         THIS},
-        {"true",         TRUE},
-        {"var",           VAR},
-        {"while",       WHILE}
-    };
+    bool deferring;
+    bool interning;
+    std::vector<Error> deferred;
 
 
 };
 
+/*
+** Keyword recognition is a hand-rolled trie: we switch on the first (and for
+** 'f' and 't' the second) character, then compare the rest of the lexeme
+** against the single keyword that can still match. This works on the source
+** bytes directly and needs neither a table nor a temporary std::string.
+*/
+constexpr TokenType checkKeyword(std::string_view text, std::size_t start,
+                                 std::string_view rest, TokenType type)
+{
+    return text.substr(start) == rest ? type : IDENTIFIER;
+}
+
+constexpr TokenType keywordType(std::string_view text)
+{
+    if(text.length() < 2 || text.length() > 8) return IDENTIFIER;
+
+    switch(text[0])
+    {
+    case 'a':
+        return checkKeyword(text, 1, "nd", AND);
+    case 'b':
+        return checkKeyword(text, 1, "reak", BREAK);
+    case 'c':
+        if(text[1] == 'l') return checkKeyword(text, 2, "ass", CLASS);
+        return checkKeyword(text, 1, "ontinue", CONTINUE);
+    case 'e':
+        return checkKeyword(text, 1, "lse", ELSE);
+    case 'f':
+        switch(text[1])
+        {
+        case 'a':
+            return checkKeyword(text, 2, "lse", FALSE);
+        case 'o':
+            return checkKeyword(text, 2, "r", FOR);
+        case 'u':
+            return checkKeyword(text, 2, "n", FUN);
+        }
+        break;
+    case 'i':
+        return checkKeyword(text, 1, "f", IF);
+    case 'n':
+        return checkKeyword(text, 1, "il", NIL);
+    case 'o':
+        return checkKeyword(text, 1, "r", OR);
+    case 'p':
+        return checkKeyword(text, 1, "rint", PRINT);
+    case 'r':
+        return checkKeyword(text, 1, "eturn", RETURN);
+    case 's':
+        return checkKeyword(text, 1, "uper", SUPER);
+    case 't':
+        if(text[1] == 'h') return checkKeyword(text, 2, "is", THIS);
+        return checkKeyword(text, 1, "rue", TRUE);
+    case 'v':
+        return checkKeyword(text, 1, "ar", VAR);
+    case 'w':
+        return checkKeyword(text, 1, "hile", WHILE);
+    }
+    return IDENTIFIER;
+}
+
+static_assert(keywordType("continue") == CONTINUE, "keyword trie is broken");
+static_assert(keywordType("this") == THIS && keywordType("true") == TRUE, "keyword trie is broken");
+static_assert(keywordType("fun") == FUN && keywordType("funny") == IDENTIFIER, "keyword trie is broken");
+static_assert(keywordType("c") == IDENTIFIER && keywordType("classes") == IDENTIFIER, "keyword trie is broken");
+
 } // namespace lox
 
 #endif
\ No newline at end of file
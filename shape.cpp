@@ -0,0 +1,36 @@
+#include"shape.h"
+
+namespace lox {
+
+/* 0 is never an id, so an unused cache entry matches nothing */
+unsigned int Shape::ids = 0;
+
+Shape::Shape(): id(++ids)
+{
+}
+
+/* instances have few fields, so a scan of them beats hashing */
+unsigned int Shape::find(Symbol name) const
+{
+    for(unsigned int slot = 0; slot < fields.size(); ++slot)
+    {
+        if(fields[slot] == name) return slot;
+    }
+    return NONE;
+}
+
+Shape* Shape::add(Symbol name)
+{
+    for(const std::unique_ptr<Shape>& shape : transitions)
+    {
+        if(shape->fields.back() == name) return shape.get();
+    }
+
+    transitions.emplace_back(new Shape());
+    Shape* shape = transitions.back().get();
+    shape->fields = fields;
+    shape->fields.push_back(name);
+    return shape;
+}
+
+} // namespace lox
@@ -0,0 +1,57 @@
+#ifndef LOX_SHAPE_H
+#define LOX_SHAPE_H
+
+#include<memory>
+#include<vector>
+
+#include"symbol.h"
+
+namespace lox {
+
+/*
+** The layout of an instance's fields, shared by every instance that got
+** its fields in the same order (a hidden class). An instance keeps its
+** fields in a plain array of Values and a pointer to its Shape, which says
+** which field is in which slot; adding a field moves the instance to the
+** Shape with that field added last.
+**
+** Each class starts with an empty Shape, and the Shapes reached from it
+** form a tree that only grows: the transition for a name, once made, is
+** taken by every later instance that adds that name at that point. A Shape
+** lives as long as its class, and is told apart from every other by its
+** id, which is never reused, so a cache can keep ids without keeping the
+** Shapes alive (see PropertyCache).
+*/
+class Shape {
+public:
+    /* what find() gives for a name that isn't a field */
+    static constexpr unsigned int NONE = ~0u;
+
+    /* an empty Shape, the root of a new tree */
+    Shape();
+    Shape(const Shape&) = delete;
+
+    /* the slot of the field called name, or NONE */
+    unsigned int find(Symbol name) const;
+    /* the Shape an instance of this one has once name is added to it */
+    Shape* add(Symbol name);
+
+    /* how many fields an instance of this Shape has */
+    unsigned int size() const {
+        return fields.size();
+    }
+
+    const unsigned int id;
+
+private:
+    /* by slot, the names of the fields */
+    std::vector<Symbol> fields;
+    /* the Shapes made from this one, each with one more field; usually one or none */
+    std::vector<std::unique_ptr<Shape>> transitions;
+
+    static unsigned int ids;
+};
+
+} // namespace lox
+
+#endif
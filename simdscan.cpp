@@ -0,0 +1,325 @@
+#include"simdscan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include<immintrin.h>
+#define LOX_SIMD_X86 1
+#endif
+
+namespace lox {
+
+namespace {
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+inline bool isIdentifierChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+           || (c >= '0' && c <= '9') || c == '_';
+}
+
+/* count of set bits in mask below bit 'index' */
+inline unsigned int bitsBelow(unsigned int mask, unsigned int index) {
+    return __builtin_popcount(mask & ((1u << index) - 1));
+}
+
+/*
+** Scalar versions. These double as the tail loops of the vector versions, which
+** only ever look at whole blocks.
+*/
+const char* skipWhitespaceScalar(const char* p, const char* end, unsigned int& lines)
+{
+    for(; p < end && isSpace(*p); ++p)
+        if(*p == '\n') lines++;
+    return p;
+}
+
+const char* findStringEndScalar(const char* p, const char* end, unsigned int& lines)
+{
+    for(; p < end && *p != '"'; ++p)
+        if(*p == '\n') lines++;
+    return p;
+}
+
+const char* findLineEndScalar(const char* p, const char* end)
+{
+    while(p < end && *p != '\n') ++p;
+    return p;
+}
+
+const char* findCommentEndScalar(const char* p, const char* end, unsigned int& lines)
+{
+    for(; p + 1 < end; ++p)
+    {
+        if(p[0] == '*' && p[1] == '/') return p;
+        if(*p == '\n') lines++;
+    }
+    /* the last byte can't start a terminator but may still be a newline */
+    if(p < end && *p == '\n') lines++;
+    return end;
+}
+
+const char* skipIdentifierScalar(const char* p, const char* end)
+{
+    while(p < end && isIdentifierChar(*p)) ++p;
+    return p;
+}
+
+#ifdef LOX_SIMD_X86
+
+/*
+** SSE2 is part of the x86-64 baseline, so these need no runtime check. Every
+** routine builds a bitmask with one bit per byte of a 16 byte block and uses
+** the lowest interesting bit to find where the run stops.
+*/
+inline __m128i identifierMask16(__m128i v)
+{
+    /* (c | 0x20) folds upper case onto lower case for the letter test */
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                   _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(letter, digit), under);
+}
+
+const char* skipWhitespaceSSE2(const char* p, const char* end, unsigned int& lines)
+{
+    for(; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                               _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                                  _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), nl));
+        unsigned int nlMask = _mm_movemask_epi8(nl);
+        unsigned int stop = ~_mm_movemask_epi8(ws) & 0xFFFF;
+        if(stop != 0)
+        {
+            unsigned int i = __builtin_ctz(stop);
+            lines += bitsBelow(nlMask, i);
+            return p + i;
+        }
+        lines += __builtin_popcount(nlMask);
+    }
+    return skipWhitespaceScalar(p, end, lines);
+}
+
+const char* findStringEndSSE2(const char* p, const char* end, unsigned int& lines)
+{
+    for(; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned int nlMask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        unsigned int quote = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+        if(quote != 0)
+        {
+            unsigned int i = __builtin_ctz(quote);
+            lines += bitsBelow(nlMask, i);
+            return p + i;
+        }
+        lines += __builtin_popcount(nlMask);
+    }
+    return findStringEndScalar(p, end, lines);
+}
+
+const char* findLineEndSSE2(const char* p, const char* end)
+{
+    for(; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned int nl = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        if(nl != 0) return p + __builtin_ctz(nl);
+    }
+    return findLineEndScalar(p, end);
+}
+
+const char* findCommentEndSSE2(const char* p, const char* end, unsigned int& lines)
+{
+    /* compare each block against '*' and the block one byte on against '/' */
+    for(; end - p >= 17; p += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+        unsigned int nlMask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        unsigned int close = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('*')),
+                                               _mm_cmpeq_epi8(next, _mm_set1_epi8('/'))));
+        if(close != 0)
+        {
+            unsigned int i = __builtin_ctz(close);
+            lines += bitsBelow(nlMask, i);
+            return p + i;
+        }
+        lines += __builtin_popcount(nlMask);
+    }
+    return findCommentEndScalar(p, end, lines);
+}
+
+const char* skipIdentifierSSE2(const char* p, const char* end)
+{
+    for(; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned int stop = ~_mm_movemask_epi8(identifierMask16(v)) & 0xFFFF;
+        if(stop != 0) return p + __builtin_ctz(stop);
+    }
+    return skipIdentifierScalar(p, end);
+}
+
+/*
+** AVX2 versions, compiled for AVX2 with a target attribute so the rest of the
+** program still runs on CPUs without it. They're only installed if the CPU
+** reports AVX2 support at startup.
+*/
+#define LOX_AVX2 __attribute__((target("avx2")))
+
+LOX_AVX2 inline __m256i identifierMask32(__m256i v)
+{
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                      _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+    __m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    return _mm256_or_si256(_mm256_or_si256(letter, digit), under);
+}
+
+LOX_AVX2 const char* skipWhitespaceAVX2(const char* p, const char* end, unsigned int& lines)
+{
+    for(; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i nl = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+        __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                     _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+                                     _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), nl));
+        unsigned int nlMask = _mm256_movemask_epi8(nl);
+        unsigned int stop = ~static_cast<unsigned int>(_mm256_movemask_epi8(ws));
+        if(stop != 0)
+        {
+            unsigned int i = __builtin_ctz(stop);
+            lines += bitsBelow(nlMask, i);
+            return p + i;
+        }
+        lines += __builtin_popcount(nlMask);
+    }
+    return skipWhitespaceSSE2(p, end, lines);
+}
+
+LOX_AVX2 const char* findStringEndAVX2(const char* p, const char* end, unsigned int& lines)
+{
+    for(; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned int nlMask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        unsigned int quote = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+        if(quote != 0)
+        {
+            unsigned int i = __builtin_ctz(quote);
+            lines += bitsBelow(nlMask, i);
+            return p + i;
+        }
+        lines += __builtin_popcount(nlMask);
+    }
+    return findStringEndSSE2(p, end, lines);
+}
+
+LOX_AVX2 const char* findLineEndAVX2(const char* p, const char* end)
+{
+    for(; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned int nl = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        if(nl != 0) return p + __builtin_ctz(nl);
+    }
+    return findLineEndSSE2(p, end);
+}
+
+LOX_AVX2 const char* findCommentEndAVX2(const char* p, const char* end, unsigned int& lines)
+{
+    for(; end - p >= 33; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+        unsigned int nlMask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        unsigned int close = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('*')),
+                             _mm256_cmpeq_epi8(next, _mm256_set1_epi8('/'))));
+        if(close != 0)
+        {
+            unsigned int i = __builtin_ctz(close);
+            lines += bitsBelow(nlMask, i);
+            return p + i;
+        }
+        lines += __builtin_popcount(nlMask);
+    }
+    return findCommentEndSSE2(p, end, lines);
+}
+
+LOX_AVX2 const char* skipIdentifierAVX2(const char* p, const char* end)
+{
+    for(; end - p >= 32; p += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned int stop = ~static_cast<unsigned int>(_mm256_movemask_epi8(identifierMask32(v)));
+        if(stop != 0) return p + __builtin_ctz(stop);
+    }
+    return skipIdentifierSSE2(p, end);
+}
+
+#endif // LOX_SIMD_X86
+
+struct ScanKernels {
+    const char* (*skipWhitespace)(const char*, const char*, unsigned int&);
+    const char* (*findStringEnd)(const char*, const char*, unsigned int&);
+    const char* (*findLineEnd)(const char*, const char*);
+    const char* (*findCommentEnd)(const char*, const char*, unsigned int&);
+    const char* (*skipIdentifier)(const char*, const char*);
+};
+
+ScanKernels selectKernels()
+{
+#ifdef LOX_SIMD_X86
+    /* we run during static initialisation, before the cpu model is set up */
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return {skipWhitespaceAVX2, findStringEndAVX2, findLineEndAVX2,
+                findCommentEndAVX2, skipIdentifierAVX2};
+    return {skipWhitespaceSSE2, findStringEndSSE2, findLineEndSSE2,
+            findCommentEndSSE2, skipIdentifierSSE2};
+#else
+    return {skipWhitespaceScalar, findStringEndScalar, findLineEndScalar,
+            findCommentEndScalar, skipIdentifierScalar};
+#endif
+}
+
+const ScanKernels kernels = selectKernels();
+
+} // namespace
+
+const char* skipWhitespace(const char* p, const char* end, unsigned int& lines)
+{
+    return kernels.skipWhitespace(p, end, lines);
+}
+
+const char* findStringEnd(const char* p, const char* end, unsigned int& lines)
+{
+    return kernels.findStringEnd(p, end, lines);
+}
+
+const char* findLineEnd(const char* p, const char* end)
+{
+    return kernels.findLineEnd(p, end);
+}
+
+const char* findCommentEnd(const char* p, const char* end, unsigned int& lines)
+{
+    return kernels.findCommentEnd(p, end, lines);
+}
+
+const char* skipIdentifier(const char* p, const char* end)
+{
+    return kernels.skipIdentifier(p, end);
+}
+
+} // namespace lox
@@ -0,0 +1,27 @@
+#ifndef LOX_SIMD_SCAN_H
+#define LOX_SIMD_SCAN_H
+
+/*
+** Bulk character-class scanning for the Scanner. Each routine walks a
+** [p, end) range and returns a pointer to where the scanner should resume,
+** adding the number of newlines it stepped over to 'lines' where that matters.
+** The implementations use AVX2 or SSE2 when the CPU has them and fall back to
+** plain loops otherwise; the choice is made once, at startup.
+*/
+
+namespace lox {
+
+/* first byte that isn't ' ', '\t', '\r' or '\n' */
+const char* skipWhitespace(const char* p, const char* end, unsigned int& lines);
+/* first '"' (the end of a string literal), or end if there is none */
+const char* findStringEnd(const char* p, const char* end, unsigned int& lines);
+/* first '\n' (the end of a // comment), or end if there is none */
+const char* findLineEnd(const char* p, const char* end);
+/* the star of the star-slash closing a block comment, or end if there is none */
+const char* findCommentEnd(const char* p, const char* end, unsigned int& lines);
+/* first byte that can't continue an identifier, i.e. isn't [A-Za-z0-9_] */
+const char* skipIdentifier(const char* p, const char* end);
+
+} // namespace lox
+
+#endif
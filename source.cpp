@@ -0,0 +1,59 @@
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+#include<fstream>
+#include<sstream>
+
+#include"source.h"
+
+namespace lox
+{
+
+Source::~Source()
+{
+    if(mapping != nullptr) munmap(mapping, mappingLength);
+}
+
+std::unique_ptr<Source> Source::fromFile(const std::string& path)
+{
+    std::unique_ptr<Source> src(new Source());
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) return nullptr;
+
+    struct stat st;
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p != MAP_FAILED)
+        {
+            /* the scanner makes a single forward pass over the file */
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            src->mapping = p;
+            src->mappingLength = st.st_size;
+            src->view = std::string_view(static_cast<const char*>(p), st.st_size);
+            close(fd);
+            return src;
+        }
+    }
+    close(fd);
+
+    /* empty files, pipes and the like can't be mapped, so read them instead */
+    std::ifstream inputStream(path);
+    if(!inputStream) return nullptr;
+    std::ostringstream buf;
+    buf << inputStream.rdbuf();
+    return fromString(buf.str());
+}
+
+std::unique_ptr<Source> Source::fromString(std::string text)
+{
+    std::unique_ptr<Source> src(new Source());
+    src->buffer = std::move(text);
+    src->view = src->buffer;
+    return src;
+}
+
+} // namespace lox
@@ -0,0 +1,42 @@
+#ifndef LOX_SOURCE_H
+#define LOX_SOURCE_H
+
+#include<cstddef>
+#include<memory>
+#include<string>
+#include<string_view>
+
+namespace lox
+{
+
+/*
+** A Source owns the bytes of a script for as long as tokens and AST nodes
+** refer to it. Files are memory-mapped read-only, so the scanner works directly
+** on the page cache and lexemes are just views into the mapping. REPL lines
+** (and files that can't be mapped) are kept in an owned buffer instead.
+*/
+class Source {
+public:
+    Source(const Source&) = delete; /* prohibit copying, views point into us */
+    ~Source();
+
+    /* returns nullptr if the file can't be opened */
+    static std::unique_ptr<Source> fromFile(const std::string& path);
+    static std::unique_ptr<Source> fromString(std::string text);
+
+    std::string_view text() const {
+        return view;
+    }
+
+private:
+    Source() = default;
+
+    std::string buffer;
+    void* mapping = nullptr;
+    std::size_t mappingLength = 0;
+    std::string_view view;
+};
+
+} // namespace lox
+
+#endif
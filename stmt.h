@@ -5,6 +5,7 @@
 #include<memory>
 #include<vector>
 
+#include"arena.h"
 #include"expr.h"
 #include"token.h"
 
@@ -12,19 +13,26 @@ namespace lox {
 
 class StmtVisitor;
 
+/*
+** Like Expr nodes, statements live in the Program's Arena and are kept small;
+** only the ones that can be reported on remember their line.
+*/
 class Stmt {
 public:
     virtual void accept(StmtVisitor& visitor) = 0;
-    virtual ~Stmt() = default;
+protected:
+    ~Stmt() = default;
 
 };
 
 
 
-typedef std::unique_ptr<Stmt> StmtPtr;
+typedef Stmt* StmtPtr;
 
 class Block;
+class Break;
 class Class;
+class Continue;
 class Expression;
 class Function;
 class If;
@@ -33,12 +41,14 @@ class Return;
 class Var;
 class While;
 
-typedef std::unique_ptr<Function> FunPtr;
+typedef Function* FunPtr;
 
 class StmtVisitor {
 public:
     virtual void visitBlockStmt(Block& stmt) = 0;
+    virtual void visitBreakStmt(Break& stmt) = 0;
     virtual void visitClassStmt(Class& stmt) = 0;
+    virtual void visitContinueStmt(Continue& stmt) = 0;
     virtual void visitExpressionStmt(Expression& stmt) = 0;
     virtual void visitFunctionStmt(Function& stmt) = 0;
     virtual void visitIfStmt(If& stmt) = 0;
@@ -52,19 +62,35 @@ public:
 
 class Block : public Stmt {
 public:
-    std::vector<StmtPtr> statements;
-    Block(std::vector<StmtPtr> statements):statements(std::move(statements)) {}
+    ArenaList<StmtPtr> statements;
+    /* how many variables it declares, set by the Resolver */
+    unsigned int slots = 0;
+    /* line is that of the '{', or of the 'for' a block was made for */
+    unsigned int line;
+    Block(ArenaList<StmtPtr> statements, unsigned int line):statements(statements), line(line) {}
     void accept(StmtVisitor& visitor)override {
         visitor.visitBlockStmt(*this);
     }
 };
+class Break : public Stmt {
+public:
+    unsigned int line;
+    explicit Break(const Token& keyword): line(keyword.line) {}
+
+    void accept(StmtVisitor& visitor)override {
+        visitor.visitBreakStmt(*this);
+    }
+};
 class Class : public Stmt {
 public:
-    Token name;
-    std::unique_ptr<Variable> superclass;
-    std::vector<FunPtr> methods;
-    Class(const Token& name, std::unique_ptr<Variable> superclass, std::vector<FunPtr> methods):
-        name(name), superclass(std::move(superclass)), methods(std::move(methods)) {}
+    Symbol name;
+    unsigned int line;
+    /* whether the class's variable lives in a Cell, set by the Resolver */
+    bool boxed = false;
+    Variable* superclass;
+    ArenaList<FunPtr> methods;
+    Class(const Token& name, Variable* superclass, ArenaList<FunPtr> methods):
+        name(name.symbol), line(name.line), superclass(superclass), methods(methods) {}
 
     void accept(StmtVisitor& visitor)override {
         visitor.visitClassStmt(*this);
@@ -72,22 +98,56 @@ public:
 
 };
 
+class Continue : public Stmt {
+public:
+    unsigned int line;
+    explicit Continue(const Token& keyword): line(keyword.line) {}
+
+    void accept(StmtVisitor& visitor)override {
+        visitor.visitContinueStmt(*this);
+    }
+};
+
 class Expression : public Stmt {
 public:
     ExprPtr expression;
-    Expression(ExprPtr expression): expression(std::move(expression)) {}
+    Expression(ExprPtr expression): expression(expression) {}
     void accept(StmtVisitor& visitor)override {
         visitor.visitExpressionStmt(*this);
     }
 };
 
+/*
+** A variable of an enclosing function that a closure uses, found when the
+** closure is created: a local of the scope the function is declared in,
+** or one the function around it captured itself.
+*/
+struct Capture {
+    bool local;
+    /* whether the local lives in a Cell */
+    bool boxed;
+    /* for a local, how many scopes out it is */
+    unsigned int depth;
+    /* its slot, or the index of the enclosing function's capture */
+    unsigned int slot;
+};
+
 class Function : public Stmt {
 public:
-    Token name;
-    std::vector<Token> params;
-    std::vector<StmtPtr> body;
-    Function(const Token& name, const std::vector<Token>& params, std::vector<StmtPtr>& body)
-        :name(name), params(params), body(std::move(body)) {}
+    Symbol name;
+    unsigned int line;
+    /* how many variables the body declares at its top level, parameters included, set by the Resolver */
+    unsigned int slots = 0;
+    /* the rest is set by the Resolver too: whether the function's own name is boxed, */
+    bool boxed = false;
+    ArenaList<Symbol> params;
+    ArenaList<StmtPtr> body;
+    /* the parameters that are */
+    ArenaList<unsigned int> boxedParams;
+    /* and what the closure captures, in the order its uses refer to them */
+    ArenaList<Capture> captures;
+    Function(const Token& name, ArenaList<Symbol> params, ArenaList<StmtPtr> body)
+        :name(name.symbol), line(name.line), params(params), body(body) {}
 
     void accept(StmtVisitor& visitor)override {
         visitor.visitFunctionStmt(*this);
@@ -99,7 +159,7 @@ public:
     StmtPtr thenBranch;
     StmtPtr elseBranch;
     If(ExprPtr condition, StmtPtr thenBranch, StmtPtr elseBranch)
-        :condition(std::move(condition)), thenBranch(std::move(thenBranch)), elseBranch(std::move(elseBranch)) {}
+        :condition(condition), thenBranch(thenBranch), elseBranch(elseBranch) {}
 
     void accept(StmtVisitor& visitor)override {
         visitor.visitIfStmt(*this);
@@ -108,7 +168,7 @@ public:
 class Print : public Stmt {
 public:
     ExprPtr expression;
-    Print(ExprPtr expression):expression(std::move(expression)) {}
+    Print(ExprPtr expression):expression(expression) {}
 
     void accept(StmtVisitor& visitor)override {
         visitor.visitPrintStmt(*this);
@@ -116,9 +176,10 @@ public:
 };
 class Return : public Stmt {
 public:
-    Token keyword;
+    /* line is that of the 'return' keyword */
+    unsigned int line;
     ExprPtr value;
-    Return(const Token& keyword, ExprPtr value): keyword(keyword), value(std::move(value)) {}
+    Return(const Token& keyword, ExprPtr value): line(keyword.line), value(value) {}
 
     void accept(StmtVisitor& visitor)override {
         visitor.visitReturnStmt(*this);
@@ -126,9 +187,12 @@ public:
 };
 class Var : public Stmt {
 public:
-    Token name;
+    Symbol name;
+    unsigned int line;
+    /* whether the variable lives in a Cell, set by the Resolver */
+    bool boxed = false;
     ExprPtr initializer;
-    Var(const Token& name, ExprPtr initializer): name(name), initializer(std::move(initializer)) {}
+    Var(const Token& name, ExprPtr initializer): name(name.symbol), line(name.line), initializer(initializer) {}
 
     void accept(StmtVisitor& visitor)override {
         visitor.visitVarStmt(*this);
@@ -139,12 +203,34 @@ class While : public Stmt {
 public:
     ExprPtr condition;
     StmtPtr body;
-    While(ExprPtr condition, StmtPtr body): condition(std::move(condition)), body(std::move(body)) {}
+    /*
+    ** A for loop's increment, run after the body each time round, even when
+    ** the body continues; nullptr for a while loop.
+    */
+    ExprPtr increment;
+    While(ExprPtr condition, StmtPtr body, ExprPtr increment = nullptr)
+        :condition(condition), body(body), increment(increment) {}
 
     void accept(StmtVisitor& visitor)override {
         visitor.visitWhileStmt(*this);
     }
 };
+static_assert(std::is_trivially_destructible<Block>::value, "Stmt nodes must not own anything");
+static_assert(std::is_trivially_destructible<Function>::value, "Stmt nodes must not own anything");
+
+/*
+** The result of parsing one compilation unit (a file or a REPL line): its
+** top-level statements and the Arena that owns every node reachable from
+** them. Destroying the Program frees the whole tree at once.
+*/
+class Program {
+public:
+    Program() = default;
+    Program(const Program&) = delete;
+
+    Arena arena;
+    std::vector<StmtPtr> statements;
+};
 
 
 }// namespace lox
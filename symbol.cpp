@@ -0,0 +1,29 @@
+#include"symbol.h"
+
+namespace lox {
+
+SymbolTable& SymbolTable::instance()
+{
+    static SymbolTable table;
+    return table;
+}
+
+Symbol SymbolTable::intern(std::string_view text)
+{
+    SymbolTable& table = instance();
+
+    auto it = table.index.find(text);
+    if(it != table.index.end()) return it->second;
+
+    Symbol symbol = table.names.size();
+    table.names.emplace_back(text);
+    table.index.emplace(table.names.back(), symbol);
+    return symbol;
+}
+
+const std::string& SymbolTable::name(Symbol symbol)
+{
+    return instance().names[symbol];
+}
+
+} // namespace lox
@@ -0,0 +1,38 @@
+#ifndef LOX_SYMBOL_H
+#define LOX_SYMBOL_H
+
+#include<deque>
+#include<string>
+#include<string_view>
+#include<unordered_map>
+
+namespace lox {
+
+/*
+** Identifiers and string literals are interned as they are scanned: each
+** distinct spelling is stored once and stands for itself as a small integer,
+** so names can be compared and hashed as numbers from then on. Symbols live
+** for the whole run, which lets the REPL share them between lines.
+**
+** The table is not thread-safe; the ParallelScanner interns on one thread
+** after its chunks are lexed.
+*/
+typedef unsigned int Symbol;
+
+class SymbolTable {
+public:
+    static Symbol intern(std::string_view text);
+    static const std::string& name(Symbol symbol);
+
+private:
+    SymbolTable() = default;
+    static SymbolTable& instance();
+
+    /* deque, because the index keys are views into these strings */
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, Symbol> index;
+};
+
+} // namespace lox
+
+#endif
@@ -0,0 +1,113 @@
+#!/bin/sh
+# Runs every script in tests/ with the given cpplox on each engine, with
+# and without the optimizer, and compares what it prints, errors included,
+# with the script's .expected file, which is the tree engine's output.
+# Also checks the parallel lexer and the AstCache give the same output.
+# Usage: tests/run.sh ./cpplox
+lox=${1:-./cpplox}
+dir=$(dirname "$0")
+out=$(mktemp)
+cache=$(mktemp -d)
+trap 'rm -rf "$out" "$cache"' EXIT
+
+# these build reference cycles, which refcounting never frees (see
+# value.h), so LeakSanitizer is turned off for them
+leaking="cycles.lox"
+
+# the scripts each engine reports as using something it can't run; each
+# must still fail with that report, so the lists can't go stale
+vm_unsupported="boxed.lox cycles.lox nested.lox recursive_captured.lox"
+closure_unsupported="boxed.lox cycles.lox nested.lox recursive_captured.lox"
+
+listed() {
+    case " $2 " in *" $1 "*) return 0;; esac
+    return 1
+}
+
+failed=0
+for script in "$dir"/*.lox; do
+    name=$(basename "$script")
+    options=$ASAN_OPTIONS
+    if listed "$name" "$leaking"; then options=detect_leaks=0; fi
+
+    for engine in tree vm closure; do
+        unsupported=
+        if [ $engine = vm ]; then unsupported=$vm_unsupported; fi
+        if [ $engine = closure ]; then unsupported=$closure_unsupported; fi
+
+        for flags in "" --no-optimize; do
+            ASAN_OPTIONS=$options $lox --engine=$engine $flags "$script" > "$out" 2>&1
+            if listed "$name" "$unsupported"; then
+                if ! grep -q "are only supported by --engine=tree" "$out"; then
+                    echo "FAIL: $lox --engine=$engine $flags $script runs now, take it off the list"
+                    failed=1
+                fi
+            elif ! diff -u "${script%.lox}.expected" "$out"; then
+                echo "FAIL: $lox --engine=$engine $flags $script"
+                failed=1
+            fi
+        done
+    done
+    # lexed in parallel, in chunks small enough that strings and comments
+    # run across their boundaries, a script must come out as it does
+    # from the sequential Scanner
+    for chunk in 1 16; do
+        ASAN_OPTIONS=$options $lox --parallel-lex-chunk=$chunk "$script" > "$out" 2>&1
+        if ! diff -u "${script%.lox}.expected" "$out"; then
+            echo "FAIL: $lox --parallel-lex-chunk=$chunk $script"
+            failed=1
+        fi
+    done
+
+    # from an empty AstCache, and then from the entry that run stored
+    for run in cold warm; do
+        ASAN_OPTIONS=$options $lox --ast-cache="$cache" "$script" > "$out" 2>&1
+        if ! diff -u "${script%.lox}.expected" "$out"; then
+            echo "FAIL: $lox --ast-cache $script, $run"
+            failed=1
+        fi
+    done
+    rm -f "$cache"/*
+
+    for engine in vm closure; do
+        eval unsupported=\$${engine}_unsupported
+        if listed "$name" "$unsupported"; then echo "skipped on --engine=$engine: $script"; fi
+    done
+done
+# a damaged entry must be a miss: the script is parsed again, runs as
+# before, and the entry is written afresh
+script=$dir/calls.lox
+$lox --ast-cache="$cache" "$script" > /dev/null 2>&1
+entry=$(ls "$cache"/*.ast)
+cp "$entry" "$cache/good"
+size=$(wc -c < "$entry")
+
+damaged() {
+    $lox --ast-cache="$cache" "$script" > "$out" 2>&1
+    if ! diff -u "${script%.lox}.expected" "$out" || ! cmp -s "$entry" "$cache/good"; then
+        echo "FAIL: $lox --ast-cache $script, with the entry $1"
+        failed=1
+    fi
+}
+
+for length in 0 1 $((size / 2)) $((size - 1)); do
+    head -c $length "$cache/good" > "$entry"
+    damaged "cut to $length bytes"
+done
+
+# flip the low bit of a spread of bytes, the last one included
+step=$((size / 32 + 1))
+at=$((size - 1))
+while [ $at -ge 0 ]; do
+    cp "$cache/good" "$entry"
+    byte=$(od -An -tu1 -j$at -N1 "$entry" | tr -d ' ')
+    printf "$(printf '\\%03o' $((byte ^ 1)))" | dd of="$entry" bs=1 seek=$at conv=notrunc 2>/dev/null
+    if cmp -s "$entry" "$cache/good"; then
+        echo "FAIL: couldn't change byte $at of the entry"
+        failed=1
+    fi
+    damaged "byte $at changed"
+    at=$((at - step))
+done
+
+exit $failed
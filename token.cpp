@@ -4,10 +4,10 @@
 namespace lox
 {
 
-Token::Token(const TokenType& type, const std::string& lexeme,const Object& literal, int line):
+Token::Token(const TokenType& type, std::string_view lexeme, double number, int line):
     type(type),
     lexeme(lexeme),
-    literal(literal),
+    number(number),
     line(line)
 {
 
@@ -17,15 +17,14 @@ std::string Token::toString()
 {
     if(type == NUMBER)
     {
-        double d = std::get<double>(literal);
-        return std::string(std::to_string(type) + " " + lexeme + " " + std::to_string(d));
+        return std::string(std::to_string(type) + " " + std::string(lexeme) + " " + std::to_string(number));
     }
     else if(type == STRING)
     {
-        return std::string(std::to_string(type) + " " + lexeme + " " + std::get<std::string>(literal));
+        return std::string(std::to_string(type) + " " + std::string(lexeme) + " " + std::string(stringValue()));
     }
     else
-        return std::string(std::to_string(type) + " " + lexeme);
+        return std::string(std::to_string(type) + " " + std::string(lexeme));
 
 
 }
@@ -1,13 +1,17 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include<initializer_list>
 #include<string>
-#include<variant>
+#include<string_view>
+
+#include"symbol.h"
 
 namespace lox
 {
 
-enum TokenType
+/* a byte, so AST nodes can keep an operator next to other small fields */
+enum TokenType : unsigned char
 {
     /*single-character tokens*/
     LEFT_PAREN, RIGHT_PAREN,LEFT_BRACE, RIGHT_BRACE,
@@ -28,30 +32,73 @@ enum TokenType
     END_OF_FILE
 };
 
-/* the pointer to void in this variant
-** must never point anywhere. It can only assume a value of
-** nullptr
- */
-typedef std::variant<double, std::string, bool, void*> Object;
-
+/*
+** A token doesn't own its text: lexeme is a view into the Source it was
+** scanned from, so the Source must outlive every token and AST node built
+** from it. String literals keep their value in the lexeme (quotes included)
+** rather than in a separate std::string, see stringValue(). Identifiers and
+** strings also carry the interned Symbol for their name or value.
+**
+** Tokens own nothing, so they are trivially destructible and can be copied
+** into the AST's Arena without needing their destructor run.
+*/
 class Token {
-    // typedef std::variant<double, std::string> Object;
 public:
     Token() = default;
-    Token(const TokenType& type, const std::string& lexeme,const Object& literal, int line);
+    Token(const TokenType& type, std::string_view lexeme, double number, int line);
     Token(const Token&) = default;
     ~Token()  = default;
     std::string toString();
+    /* the contents of a STRING token without the surrounding quotes */
+    std::string_view stringValue() const {
+        return lexeme.substr(1, lexeme.length() - 2);
+    }
 
 public:
     TokenType type;
-    std::string lexeme;
-    Object literal;
+    std::string_view lexeme;
+    /* the value of a NUMBER token */
+    double number;
     unsigned int line;
+    /* only meaningful for IDENTIFIER and STRING tokens */
+    Symbol symbol = 0;
+
+
+};
 
 
+/*
+** A set of token types as a bitmask, so the parser can test a token against
+** several types with a single AND. It is built at compile time from a braced
+** list, e.g. match({BANG, MINUS}).
+*/
+class TokenSet {
+public:
+    constexpr TokenSet(std::initializer_list<TokenType> types): mask(0) {
+        for(TokenType t : types) mask |= bit(t);
+    }
+    constexpr bool contains(TokenType type) const {
+        return (mask & bit(type)) != 0;
+    }
+
+private:
+    static constexpr unsigned long long bit(TokenType type) {
+        return 1ULL << type;
+    }
+    unsigned long long mask;
 };
 
+static_assert(END_OF_FILE < 64, "TokenSet holds at most 64 token types");
+
+/*
+** Something the parser can pull tokens from one at a time. Once the source is
+** exhausted it keeps returning END_OF_FILE.
+*/
+class TokenSource {
+public:
+    virtual Token nextToken() = 0;
+    virtual ~TokenSource() = default;
+};
 
 }// namespace lox
 
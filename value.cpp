@@ -0,0 +1,209 @@
+#include<utility>
+#include<vector>
+
+#include"callable.h"
+#include"chunk.h"
+#include"closurecompiler.h"
+#include"instance.h"
+#include"value.h"
+
+namespace lox {
+
+namespace {
+
+/* the worklist of the destroy() call under way, or nullptr, see there */
+std::vector<Obj*>* pending = nullptr;
+
+class FreeingScope {
+public:
+    explicit FreeingScope(std::vector<Obj*>& worklist) {
+        pending = &worklist;
+    }
+    FreeingScope(const FreeingScope&) = delete;
+    ~FreeingScope() {
+        pending = nullptr;
+    }
+};
+
+/* shorter results are copied flat, a rope node isn't worth it for them */
+constexpr std::size_t MIN_ROPE_LENGTH = 256;
+
+/*
+** Frees s, which nothing refers to any more. Ropes are freed with a
+** worklist rather than by recursion, since one built a piece at a time is
+** as deep as it is long.
+*/
+void freeString(ObjString* s)
+{
+    if(!s->isRope())
+    {
+        delete s;
+        return;
+    }
+
+    std::vector<ObjString*> pending{s};
+    while(!pending.empty())
+    {
+        ObjString* rope = pending.back();
+        pending.pop_back();
+        for(ObjString* half : {rope->left, rope->right})
+        {
+            if(half == nullptr || --half->refs != 0) continue;
+            if(half->isRope()) pending.push_back(half);
+            else delete half;
+        }
+        delete rope;
+    }
+}
+
+void release(ObjString* s)
+{
+    if(--s->refs == 0) freeString(s);
+}
+
+ObjString* newString()
+{
+    ObjString* s = new ObjString();
+    s->type = ObjType::STRING;
+    s->refs = 1;
+    return s;
+}
+
+void freeObject(Obj* obj)
+{
+    switch(obj->type)
+    {
+    case ObjType::STRING:
+        freeString(static_cast<ObjString*>(obj));
+        break;
+    case ObjType::FUNCTION:
+    case ObjType::NATIVE:
+    case ObjType::CLASS:
+    case ObjType::BOUND_METHOD:
+        delete static_cast<LoxCallable*>(obj);
+        break;
+    case ObjType::CELL:
+        delete static_cast<Cell*>(obj);
+        break;
+    case ObjType::INSTANCE:
+        delete static_cast<LoxInstance*>(obj);
+        break;
+    case ObjType::COMPILED:
+        delete static_cast<CompiledFunction*>(obj);
+        break;
+    case ObjType::CODE:
+        delete static_cast<CodeFunction*>(obj);
+        break;
+    }
+}
+
+} // namespace
+
+Value Value::string(std::string chars)
+{
+    ObjString* s = newString();
+    s->length = chars.size();
+    s->chars = std::move(chars);
+
+    Value value;
+    value.bits = SIGN | QNAN | reinterpret_cast<std::uintptr_t>(static_cast<Obj*>(s));
+    return value;
+}
+
+/*
+** A flat string nobody else can see, such as the result of the previous +
+** in a + b + c, is extended in place. Otherwise short results are copied
+** and long ones become a rope over the two operands.
+*/
+Value Value::concatenate(Value left, const Value& right)
+{
+    ObjString* l = static_cast<ObjString*>(left.asObj());
+    ObjString* r = static_cast<ObjString*>(right.asObj());
+
+    if(l->refs == 1 && !l->isRope())
+    {
+        l->chars += r->text();
+        l->length = l->chars.size();
+        return left;
+    }
+
+    std::size_t length = l->length + r->length;
+    if(length < MIN_ROPE_LENGTH) return string(l->text() + r->text());
+
+    ObjString* rope = newString();
+    rope->left = l;
+    rope->right = r;
+    rope->length = length;
+    ++l->refs;
+    ++r->refs;
+
+    Value value;
+    value.bits = SIGN | QNAN | reinterpret_cast<std::uintptr_t>(static_cast<Obj*>(rope));
+    return value;
+}
+
+/*
+** Copies the leaves into chars left to right, walking the tree with an
+** explicit stack of the right halves still to visit. Halves shared with
+** other strings are only read, so each of them stays a rope or flat as it
+** was.
+*/
+void ObjString::flatten()
+{
+    std::string flat;
+    flat.reserve(length);
+
+    std::vector<ObjString*> pending;
+    ObjString* node = this;
+    for(;;)
+    {
+        while(node->isRope())
+        {
+            pending.push_back(node->right);
+            node = node->left;
+        }
+        flat += node->chars;
+        if(pending.empty()) break;
+        node = pending.back();
+        pending.pop_back();
+    }
+
+    chars = std::move(flat);
+    ObjString* l = left;
+    ObjString* r = right;
+    left = right = nullptr;
+    release(l);
+    release(r);
+}
+
+/*
+** Freeing an object releases the Values it holds, which may free those in
+** turn, so a linked list of instances would be freed by recursion as deep
+** as the list is long. Objects that die while another is being freed are
+** queued instead, on a worklist that belongs to the outermost call, and
+** freed one after another by it.
+**
+** Values are still released while statics are being destroyed at exit, so
+** all this needs outside a call is a plain pointer, which is never
+** destroyed; and FreeingScope takes it back however the call ends.
+*/
+void Value::destroy(Obj* obj)
+{
+    if(pending != nullptr)
+    {
+        pending->push_back(obj);
+        return;
+    }
+
+    std::vector<Obj*> worklist;
+    FreeingScope scope(worklist);
+    for(;;)
+    {
+        freeObject(obj);
+        if(worklist.empty()) break;
+        obj = worklist.back();
+        worklist.pop_back();
+    }
+}
+
+} // namespace lox
@@ -0,0 +1,208 @@
+#ifndef LOX_VALUE_H
+#define LOX_VALUE_H
+
+#include<cstddef>
+#include<cstdint>
+#include<cstring>
+#include<string>
+
+namespace lox {
+
+/*
+** Everything that doesn't fit in a Value lives on the heap as an Obj, and is
+** reference counted by the Values that point to it. The interpreter is
+** single threaded, so the counts are plain integers.
+**
+** Nothing collects cycles: objects that refer to one another, such as an
+** instance kept in one of its own fields or a bound method stored on the
+** instance it is bound to, are never freed, even once the program can't
+** reach them. tests/cycles.lox shows the known cases.
+*/
+enum class ObjType : unsigned char {
+    STRING,
+    FUNCTION,   /* see callable.h */
+    NATIVE,
+    CELL,
+    CLASS,      /* see instance.h */
+    INSTANCE,
+    BOUND_METHOD,
+    COMPILED,   /* see chunk.h */
+    CODE        /* see closurecompiler.h */
+};
+
+struct Obj {
+    ObjType type;
+    unsigned int refs;
+};
+
+/*
+** A string is either flat, with its text in chars, or a rope: the
+** concatenation of left and right, which it holds references to. Long
+** strings are concatenated into ropes in constant time, so building one up
+** piece by piece with s = s + piece doesn't copy everything so far each
+** time. A rope is flattened the first time its text is needed, e.g. to print
+** or compare it, and then lets go of its halves.
+*/
+struct ObjString : Obj {
+    std::string chars;
+    ObjString* left = nullptr;
+    ObjString* right = nullptr;
+    std::size_t length = 0;
+
+    bool isRope() const {
+        return left != nullptr;
+    }
+    const std::string& text() {
+        if(isRope()) flatten();
+        return chars;
+    }
+    void flatten();
+};
+
+/*
+** A Lox value in 64 bits, NaN-boxed: any double is stored as itself, and
+** the other types hide in the payload of a quiet NaN that arithmetic never
+** produces. With the sign bit clear, the low bits say whether it is nil,
+** false or true; with it set, the low 48 bits are a pointer to an Obj.
+** Numbers, booleans and nil are copied without touching memory, and
+** copying a string only bumps its count.
+*/
+class Value {
+public:
+    Value(): bits(NIL) {}
+    Value(std::nullptr_t): bits(NIL) {}
+    Value(bool b): bits(b ? TRUE_VALUE : FALSE_VALUE) {}
+    Value(double number) {
+        std::memcpy(&bits, &number, sizeof bits);
+    }
+    /* no pointer may turn into a bool by accident */
+    template<typename T> Value(T*) = delete;
+
+    static Value string(std::string chars);
+    /* a Value that holds a reference to obj */
+    static Value object(Obj* obj) {
+        Value value;
+        value.bits = SIGN | QNAN | reinterpret_cast<std::uintptr_t>(obj);
+        value.retain();
+        return value;
+    }
+    /* left + right for two strings, see ObjString */
+    static Value concatenate(Value left, const Value& right);
+
+    Value(const Value& other): bits(other.bits) {
+        retain();
+    }
+    Value(Value&& other) noexcept : bits(other.bits) {
+        other.bits = NIL;
+    }
+    Value& operator=(const Value& other) {
+        other.retain();
+        release();
+        bits = other.bits;
+        return *this;
+    }
+    Value& operator=(Value&& other) noexcept {
+        if(this != &other)
+        {
+            release();
+            bits = other.bits;
+            other.bits = NIL;
+        }
+        return *this;
+    }
+    ~Value() {
+        release();
+    }
+
+    bool isNumber() const {
+        return (bits & QNAN) != QNAN;
+    }
+    bool isNil() const {
+        return bits == NIL;
+    }
+    bool isBool() const {
+        return (bits | 1) == TRUE_VALUE;
+    }
+    bool isObj() const {
+        return (bits & (SIGN | QNAN)) == (SIGN | QNAN);
+    }
+    bool isString() const {
+        return isObj() && asObj()->type == ObjType::STRING;
+    }
+    /* a LoxCallable, see callable.h */
+    bool isCallable() const {
+        if(!isObj()) return false;
+        ObjType type = asObj()->type;
+        return type == ObjType::FUNCTION || type == ObjType::NATIVE || type == ObjType::CLASS ||
+               type == ObjType::BOUND_METHOD;
+    }
+    /* a LoxClass, see instance.h */
+    bool isClass() const {
+        return isObj() && asObj()->type == ObjType::CLASS;
+    }
+    /* a LoxInstance, see instance.h */
+    bool isInstance() const {
+        return isObj() && asObj()->type == ObjType::INSTANCE;
+    }
+
+    /* a CompiledFunction, see chunk.h */
+    bool isCompiled() const {
+        return isObj() && asObj()->type == ObjType::COMPILED;
+    }
+
+    /* a CodeFunction, see closurecompiler.h */
+    bool isCode() const {
+        return isObj() && asObj()->type == ObjType::CODE;
+    }
+
+    /* everything else but false and nil is truthy in Lox */
+    bool isTruthy() const {
+        return bits != NIL && bits != FALSE_VALUE;
+    }
+
+    double asNumber() const {
+        double number;
+        std::memcpy(&number, &bits, sizeof number);
+        return number;
+    }
+    bool asBool() const {
+        return bits == TRUE_VALUE;
+    }
+    Obj* asObj() const {
+        return reinterpret_cast<Obj*>(static_cast<std::uintptr_t>(bits & ~(SIGN | QNAN)));
+    }
+    /* flattens a rope, see ObjString */
+    const std::string& asString() const {
+        return static_cast<ObjString*>(asObj())->text();
+    }
+
+    /* Lox's ==: numbers and strings by value, everything else by identity */
+    bool operator==(const Value& other) const {
+        if(isNumber() && other.isNumber()) return asNumber() == other.asNumber();
+        if(bits == other.bits) return true;
+        return isString() && other.isString() && asString() == other.asString();
+    }
+
+private:
+    static constexpr std::uint64_t SIGN = 0x8000000000000000;
+    static constexpr std::uint64_t QNAN = 0x7ffc000000000000;
+    static constexpr std::uint64_t NIL = QNAN | 1;
+    static constexpr std::uint64_t FALSE_VALUE = QNAN | 2;
+    static constexpr std::uint64_t TRUE_VALUE = QNAN | 3;
+
+    void retain() const {
+        if(isObj()) ++asObj()->refs;
+    }
+    void release() {
+        if(isObj() && --asObj()->refs == 0) destroy(asObj());
+    }
+    static void destroy(Obj* obj);
+
+    std::uint64_t bits;
+};
+
+static_assert(sizeof(Value) == 8, "a Value must fit in a register");
+
+} // namespace lox
+
+#endif
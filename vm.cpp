@@ -0,0 +1,311 @@
+#include<cstring>
+#include<string>
+
+#include"callable.h"
+#include"environment.h"
+#include"interpreter.h"
+#include"lox.h"
+#include"runtimeerror.h"
+#include"vm.h"
+
+#if defined(__GNUC__)
+#define LOX_COMPUTED_GOTO
+#endif
+
+namespace lox {
+
+namespace {
+
+inline std::uint32_t readOperand(const std::uint8_t*& ip)
+{
+    std::uint32_t n = *ip++;
+    if(n < 0x80) return n;
+
+    n &= 0x7f;
+    for(unsigned int shift = 7;; shift += 7)
+    {
+        std::uint32_t byte = *ip++;
+        n |= (byte & 0x7f) << shift;
+        if(byte < 0x80) return n;
+    }
+}
+
+inline std::uint32_t readJump(const std::uint8_t*& ip)
+{
+    std::uint32_t distance;
+    std::memcpy(&distance, ip, sizeof distance);
+    ip += sizeof distance;
+    return distance;
+}
+
+/* ip has already moved past at least the opcode of the failing instruction */
+[[noreturn]] void error(const Chunk& chunk, const std::uint8_t* ip, const std::string& message)
+{
+    throw RuntimeError(chunk.lineAt(ip - 1 - chunk.code.data()), message);
+}
+
+std::string arityError(unsigned int arity, std::uint32_t count)
+{
+    return "Expected " + std::to_string(arity) + " arguments but got " + std::to_string(count) + ".";
+}
+
+} // namespace
+
+/* as many slots as the Interpreter's FrameStack, and its natives */
+VM::VM(): stack(FrameStack::DEFAULT_SLOTS)
+{
+    frames.reserve(Interpreter::MAX_CALL_DEPTH);
+    Global& clock = global(SymbolTable::intern("clock"));
+    clock.value = Value::object(new NativeFunction(0, clockNative));
+    clock.defined = true;
+}
+
+void VM::interpret(const Chunk& chunk)
+{
+    if(stack.size() < chunk.maxStack) stack.resize(chunk.maxStack);
+
+    try {
+        run(chunk);
+    }
+    catch(const RuntimeError& err)
+    {
+        /* let go of whatever the frames still had on the stack */
+        for(Value& value : stack) value = nullptr;
+        frames.clear();
+        Lox::runtimeError(err);
+    }
+}
+
+#ifdef LOX_COMPUTED_GOTO
+#define DISPATCH() goto *labels[*ip++]
+#define CASE(op) L_##op
+#else
+#define DISPATCH() continue
+#define CASE(op) case op
+#endif
+
+#define NUMBER_OPERANDS() \
+    if(!sp[-2].isNumber() || !sp[-1].isNumber()) error(*chunk, ip, "Operand must be a number.")
+
+/*
+** Both operands of arithmetic and comparisons are known to be numbers by
+** the time the result is stored, so popping the right one needs nothing
+** released, and the result overwrites the left one in place.
+**
+** A call leaves the callee below the frame, which keeps it alive while it
+** runs, and its return puts the result there and clears the rest of the
+** frame, so the stack above the top still holds no references.
+**
+** A computed goto leaves a block without running destructors, so nothing
+** declared inside an instruction may need one.
+*/
+void VM::run(const Chunk& program)
+{
+    const Chunk* chunk = &program;
+    const std::uint8_t* ip = chunk->code.data();
+    const Value* constants = chunk->constants.data();
+    Value* slots = stack.data();
+    Value* sp = slots;
+
+#ifdef LOX_COMPUTED_GOTO
+    static void* const labels[] = {
+        &&L_OP_CONSTANT, &&L_OP_NIL, &&L_OP_TRUE, &&L_OP_FALSE, &&L_OP_POP,
+        &&L_OP_POPN, &&L_OP_GET_LOCAL, &&L_OP_SET_LOCAL, &&L_OP_GET_GLOBAL,
+        &&L_OP_DEFINE_GLOBAL, &&L_OP_SET_GLOBAL, &&L_OP_GET_CALLEE, &&L_OP_EQUAL, &&L_OP_GREATER,
+        &&L_OP_GREATER_EQUAL, &&L_OP_LESS, &&L_OP_LESS_EQUAL, &&L_OP_ADD,
+        &&L_OP_SUBTRACT, &&L_OP_MULTIPLY, &&L_OP_DIVIDE, &&L_OP_NOT,
+        &&L_OP_NEGATE, &&L_OP_PRINT, &&L_OP_JUMP, &&L_OP_JUMP_IF_FALSE,
+        &&L_OP_JUMP_IF_TRUE, &&L_OP_LOOP, &&L_OP_CALL, &&L_OP_OVERFLOW,
+        &&L_OP_RETURN
+    };
+    static_assert(sizeof labels / sizeof labels[0] == OP_RETURN + 1, "a label for every OpCode");
+    DISPATCH();
+#else
+    for(;;) switch(*ip++) {
+#endif
+
+    CASE(OP_CONSTANT):
+        *sp++ = constants[readOperand(ip)];
+        DISPATCH();
+    CASE(OP_NIL):
+        *sp++ = nullptr;
+        DISPATCH();
+    CASE(OP_TRUE):
+        *sp++ = true;
+        DISPATCH();
+    CASE(OP_FALSE):
+        *sp++ = false;
+        DISPATCH();
+    CASE(OP_POP):
+        *--sp = nullptr;
+        DISPATCH();
+    CASE(OP_POPN):
+        for(std::uint32_t n = readOperand(ip); n > 0; --n) *--sp = nullptr;
+        DISPATCH();
+    CASE(OP_GET_LOCAL):
+        *sp++ = slots[readOperand(ip)];
+        DISPATCH();
+    CASE(OP_SET_LOCAL):
+        slots[readOperand(ip)] = sp[-1];
+        DISPATCH();
+    CASE(OP_GET_GLOBAL): {
+        Symbol name = readOperand(ip);
+        if(name >= globals.size() || !globals[name].defined)
+            error(*chunk, ip, "Undefined Identifier '" + SymbolTable::name(name) + "' .");
+        *sp++ = globals[name].value;
+        DISPATCH();
+    }
+    CASE(OP_DEFINE_GLOBAL): {
+        Global& g = global(readOperand(ip));
+        g.value = std::move(*--sp);
+        g.defined = true;
+        DISPATCH();
+    }
+    CASE(OP_SET_GLOBAL): {
+        Symbol name = readOperand(ip);
+        if(name >= globals.size() || !globals[name].defined)
+            error(*chunk, ip, "Undefined Identifier '" + SymbolTable::name(name) + "' .");
+        globals[name].value = sp[-1];
+        DISPATCH();
+    }
+    CASE(OP_GET_CALLEE):
+        /* a call leaves the function just below its frame, see OP_CALL */
+        *sp++ = slots[-1];
+        DISPATCH();
+    CASE(OP_EQUAL): {
+        bool equal = sp[-2] == sp[-1];
+        *--sp = nullptr;
+        sp[-1] = equal;
+        DISPATCH();
+    }
+    CASE(OP_GREATER):
+        NUMBER_OPERANDS();
+        sp[-2] = sp[-2].asNumber() > sp[-1].asNumber();
+        --sp;
+        DISPATCH();
+    CASE(OP_GREATER_EQUAL):
+        NUMBER_OPERANDS();
+        sp[-2] = sp[-2].asNumber() >= sp[-1].asNumber();
+        --sp;
+        DISPATCH();
+    CASE(OP_LESS):
+        NUMBER_OPERANDS();
+        sp[-2] = sp[-2].asNumber() < sp[-1].asNumber();
+        --sp;
+        DISPATCH();
+    CASE(OP_LESS_EQUAL):
+        NUMBER_OPERANDS();
+        sp[-2] = sp[-2].asNumber() <= sp[-1].asNumber();
+        --sp;
+        DISPATCH();
+    CASE(OP_ADD):
+        if(sp[-2].isNumber() && sp[-1].isNumber())
+        {
+            sp[-2] = sp[-2].asNumber() + sp[-1].asNumber();
+            --sp;
+            DISPATCH();
+        }
+        if(sp[-2].isString() && sp[-1].isString())
+        {
+            sp[-2] = Value::concatenate(std::move(sp[-2]), sp[-1]);
+            *--sp = nullptr;
+            DISPATCH();
+        }
+        error(*chunk, ip, "Operands must be two numbers or two strings.");
+    CASE(OP_SUBTRACT):
+        NUMBER_OPERANDS();
+        sp[-2] = sp[-2].asNumber() - sp[-1].asNumber();
+        --sp;
+        DISPATCH();
+    CASE(OP_MULTIPLY):
+        NUMBER_OPERANDS();
+        sp[-2] = sp[-2].asNumber() * sp[-1].asNumber();
+        --sp;
+        DISPATCH();
+    CASE(OP_DIVIDE):
+        NUMBER_OPERANDS();
+        sp[-2] = sp[-2].asNumber() / sp[-1].asNumber();
+        --sp;
+        DISPATCH();
+    CASE(OP_NOT):
+        sp[-1] = !sp[-1].isTruthy();
+        DISPATCH();
+    CASE(OP_NEGATE):
+        if(!sp[-1].isNumber()) error(*chunk, ip, "Operand must be a number.");
+        sp[-1] = -sp[-1].asNumber();
+        DISPATCH();
+    CASE(OP_PRINT):
+        Interpreter::print(sp[-1]);
+        *--sp = nullptr;
+        DISPATCH();
+    CASE(OP_JUMP): {
+        std::uint32_t distance = readJump(ip);
+        ip += distance;
+        DISPATCH();
+    }
+    CASE(OP_JUMP_IF_FALSE): {
+        std::uint32_t distance = readJump(ip);
+        if(!sp[-1].isTruthy()) ip += distance;
+        DISPATCH();
+    }
+    CASE(OP_JUMP_IF_TRUE): {
+        std::uint32_t distance = readJump(ip);
+        if(sp[-1].isTruthy()) ip += distance;
+        DISPATCH();
+    }
+    CASE(OP_LOOP): {
+        std::uint32_t distance = readJump(ip);
+        ip -= distance;
+        DISPATCH();
+    }
+    CASE(OP_CALL): {
+        std::uint32_t count = readOperand(ip);
+        Value* callee = sp - count - 1;
+        if(callee->isCompiled())
+        {
+            CompiledFunction* function = static_cast<CompiledFunction*>(callee->asObj());
+            if(count != function->arity) error(*chunk, ip, arityError(function->arity, count));
+            if(frames.size() == Interpreter::MAX_CALL_DEPTH ||
+               function->chunk.maxStack > static_cast<std::size_t>(stack.data() + stack.size() - sp + count))
+                error(*chunk, ip, "Stack overflow.");
+
+            frames.push_back(Frame{chunk, ip, slots});
+            chunk = &function->chunk;
+            ip = chunk->code.data();
+            constants = chunk->constants.data();
+            slots = callee + 1;
+            DISPATCH();
+        }
+        if(callee->isObj() && callee->asObj()->type == ObjType::NATIVE)
+        {
+            NativeFunction* native = static_cast<NativeFunction*>(callee->asObj());
+            if(count != native->arity()) error(*chunk, ip, arityError(native->arity(), count));
+            *callee = native->invoke(callee + 1);
+            while(sp != callee + 1) *--sp = nullptr;
+            DISPATCH();
+        }
+        error(*chunk, ip, "Can only call functions and classes.");
+    }
+    CASE(OP_OVERFLOW):
+        error(*chunk, ip, "Stack overflow.");
+    CASE(OP_RETURN):
+        if(frames.empty()) return;
+        slots[-1] = std::move(sp[-1]);
+        while(sp != slots) *--sp = nullptr;
+        chunk = frames.back().chunk;
+        ip = frames.back().ip;
+        slots = frames.back().slots;
+        frames.pop_back();
+        constants = chunk->constants.data();
+        DISPATCH();
+
+#ifndef LOX_COMPUTED_GOTO
+    }
+#endif
+}
+
+#undef NUMBER_OPERANDS
+#undef CASE
+#undef DISPATCH
+
+} // namespace lox
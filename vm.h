@@ -0,0 +1,66 @@
+#ifndef LOX_VM_H
+#define LOX_VM_H
+
+#include<cstdint>
+#include<vector>
+
+#include"chunk.h"
+#include"symbol.h"
+#include"value.h"
+
+namespace lox {
+
+/*
+** Runs Chunks made by the Compiler: the alternative to walking the tree
+** with the Interpreter. Operands and temporaries live on one stack of
+** Values, with the local variables at the bottom, and globals in a table
+** indexed by Symbol, so no name is looked up by hashing at run time.
+**
+** A call gives the function a frame on the same stack, starting at its
+** first argument, and saves where the caller was in a Frame. The stack is
+** allocated once and never moves; a call that would take it past the end,
+** or make more calls deep than the Interpreter allows, is a stack overflow.
+**
+** Where the compiler supports taking the address of a label (GCC, Clang),
+** each instruction jumps straight to the next one's code through a table,
+** rather than going back round a switch; see run().
+**
+** Globals stay defined from one Chunk to the next, as they do between the
+** lines of the REPL.
+*/
+class VM {
+public:
+    VM();
+    VM(const VM&) = delete;
+
+    /* a runtime error is reported through Lox, and ends the chunk */
+    void interpret(const Chunk& chunk);
+
+private:
+    struct Global {
+        Value value;
+        bool defined = false;
+    };
+
+    /* a caller to go back to */
+    struct Frame {
+        const Chunk* chunk;
+        const std::uint8_t* ip;
+        Value* slots;
+    };
+
+    void run(const Chunk& chunk);
+    Global& global(Symbol name) {
+        if(name >= globals.size()) globals.resize(name + 1);
+        return globals[name];
+    }
+
+    /* above the top there are no references, only stale numbers at most */
+    std::vector<Value> stack;
+    std::vector<Frame> frames;
+    std::vector<Global> globals;
+};
+
+} // namespace lox
+
+#endif